@@ -0,0 +1,184 @@
+//----------------------------------------------------------------------------------------------//
+// FILE: bmpBench.cpp                                                                           //
+//                                                                                              //
+// Compares the stream (Image::loadBmp) and mapped (Image::loadBmpMapped) bmp loaders, and the //
+// scalar and vectorized row decoders, on square images at every supported bit depth.          //
+//                                                                                              //
+// usage: bmpbench [max image size px] [scratch directory]                                     //
+//----------------------------------------------------------------------------------------------//
+
+#define SK_NO_MAIN
+#include "snake.cpp"
+
+#include <limits>
+
+namespace bench
+{
+
+struct Format
+{
+  const char* _name;
+  int _bitsPerPixel;
+  uint32_t _compression;
+  uint32_t _masks[3];                 // red, green, blue; only used with BI_BITFIELDS.
+};
+
+constexpr std::array<Format, 9> formats {{
+  {"1-bit paletted",     1,  sk::BI_RGB,       {0, 0, 0}},
+  {"2-bit paletted",     2,  sk::BI_RGB,       {0, 0, 0}},
+  {"4-bit paletted",     4,  sk::BI_RGB,       {0, 0, 0}},
+  {"8-bit paletted",     8,  sk::BI_RGB,       {0, 0, 0}},
+  {"16-bit 555",         16, sk::BI_RGB,       {0, 0, 0}},
+  {"16-bit 565 fields",  16, sk::BI_BITFIELDS, {0xf800, 0x07e0, 0x001f}},
+  {"24-bit BGR",         24, sk::BI_RGB,       {0, 0, 0}},
+  {"32-bit BGRA",        32, sk::BI_RGB,       {0, 0, 0}},
+  {"32-bit fields",      32, sk::BI_BITFIELDS, {0x000000ff, 0x0000ff00, 0x00ff0000}},
+}};
+
+constexpr int repeats {3};
+
+void writeLittleEndian(std::ofstream& os, uint32_t value, int size_bytes)
+{
+  for(int i = 0; i < size_bytes; ++i)
+    os.put(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+// Writes a bmp with a BITMAPINFOHEADER (plus appended masks for BI_BITFIELDS) filled with 
+// pseudo-random pixels.
+bool writeBmp(const std::string& filename, const Format& format, int size_px)
+{
+  std::ofstream os {filename, std::ios_base::binary | std::ios_base::trunc};
+  if(!os)
+    return false;
+
+  bool isPaletted = format._bitsPerPixel <= 8;
+  int numPaletteColors = isPaletted ? (1 << format._bitsPerPixel) : 0;
+  int masksSize_bytes = (format._compression == sk::BI_BITFIELDS) ? 12 : 0;
+  uint32_t rowSize_bytes = ((format._bitsPerPixel * size_px + 31) / 32) * 4;
+  uint32_t pixelOffset_bytes = 14 + 40 + masksSize_bytes + (numPaletteColors * 4);
+  uint32_t fileSize_bytes = pixelOffset_bytes + (rowSize_bytes * size_px);
+
+  writeLittleEndian(os, sk::bitmapFileMagic, 2);
+  writeLittleEndian(os, fileSize_bytes, 4);
+  writeLittleEndian(os, 0, 4);
+  writeLittleEndian(os, pixelOffset_bytes, 4);
+
+  writeLittleEndian(os, 40, 4);
+  writeLittleEndian(os, size_px, 4);
+  writeLittleEndian(os, size_px, 4);
+  writeLittleEndian(os, 1, 2);
+  writeLittleEndian(os, format._bitsPerPixel, 2);
+  writeLittleEndian(os, format._compression, 4);
+  writeLittleEndian(os, rowSize_bytes * size_px, 4);
+  writeLittleEndian(os, 2835, 4);
+  writeLittleEndian(os, 2835, 4);
+  writeLittleEndian(os, numPaletteColors, 4);
+  writeLittleEndian(os, 0, 4);
+
+  if(masksSize_bytes)
+    for(uint32_t mask : format._masks)
+      writeLittleEndian(os, mask, 4);
+
+  for(int i = 0; i < numPaletteColors; ++i)
+    writeLittleEndian(os, (i * 0x9e3779b1u) & 0x00ffffff, 4);
+
+  uint32_t seed {0x12345678};
+  std::vector<char> row(rowSize_bytes);
+  for(int i = 0; i < size_px; ++i){
+    for(auto& byte : row){
+      seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;    // xorshift32.
+      byte = static_cast<char>(seed);
+    }
+    os.write(row.data(), row.size());
+  }
+
+  return static_cast<bool>(os);
+}
+
+bool isSamePixels(const sk::Image& a, const sk::Image& b)
+{
+  const std::vector<sk::Color4>& pa = a.getPixels();
+  const std::vector<sk::Color4>& pb = b.getPixels();
+  return pa.size() == pb.size() && memcmp(pa.data(), pb.data(), pa.size() * sizeof(sk::Color4)) == 0;
+}
+
+// returns the best time in ms over all repeats.
+template<typename Load>
+double timeLoad(Load load)
+{
+  double best {std::numeric_limits<double>::max()};
+  for(int i = 0; i < repeats; ++i){
+    auto now0 = std::chrono::steady_clock::now();
+    load();
+    auto now1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(now1 - now0).count());
+  }
+  return best;
+}
+
+}; // namespace bench
+
+int main(int argc, char** argv)
+{
+  int maxSize_px = (argc > 1) ? std::atoi(argv[1]) : 16384;
+  std::string directory = (argc > 2) ? argv[2] : "/tmp";
+
+  std::cout << std::left << std::setw(20) << "format" << std::right
+            << std::setw(8) << "size"
+            << std::setw(14) << "stream (ms)"
+            << std::setw(14) << "mapped (ms)"
+            << std::setw(10) << "speedup"
+            << std::setw(14) << "scalar (ms)"
+            << std::setw(10) << "simd"
+            << std::setw(14) << "mapped MB/s" << std::endl;
+
+  for(int size_px = 1024; size_px <= maxSize_px; size_px *= 2){
+    for(const auto& format : bench::formats){
+      std::string filename = directory + "/bmpbench.bmp";
+      if(!bench::writeBmp(filename, format, size_px)){
+        std::cerr << "failed to write " << filename << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      double streamTime = bench::timeLoad([&filename](){
+        sk::Image image {};
+        image.loadBmp(filename);
+      });
+      double mappedTime = bench::timeLoad([&filename](){
+        sk::Image image {};
+        image.loadBmpMapped(filename);
+      });
+
+      // mapped loader restricted to the scalar row decoders.
+      sk::maxSimdLevel = sk::SIMD_NONE;
+      double scalarTime = bench::timeLoad([&filename](){
+        sk::Image image {};
+        image.loadBmpMapped(filename);
+      });
+      sk::Image scalarImage {};
+      scalarImage.loadBmpMapped(filename);
+      sk::maxSimdLevel = sk::SIMD_AVX2;
+
+      sk::Image streamImage {}, mappedImage {};
+      if(streamImage.loadBmp(filename) != 0 || mappedImage.loadBmpMapped(filename) != 0 ||
+         !bench::isSamePixels(streamImage, mappedImage) || 
+         !bench::isSamePixels(scalarImage, mappedImage)){
+        std::cerr << "loaders disagree: " << format._name << " " << size_px << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      double fileSize_mb = (((format._bitsPerPixel * size_px + 31) / 32) * 4.0 * size_px) / 1.0e6;
+      std::cout << std::left << std::setw(20) << format._name << std::right
+                << std::setw(8) << size_px
+                << std::setw(14) << std::fixed << std::setprecision(2) << streamTime
+                << std::setw(14) << mappedTime
+                << std::setw(9) << streamTime / mappedTime << "x"
+                << std::setw(14) << scalarTime
+                << std::setw(9) << scalarTime / mappedTime << "x"
+                << std::setw(14) << std::setprecision(0) << fileSize_mb / (mappedTime / 1000.0)
+                << std::endl;
+
+      std::remove(filename.c_str());
+    }
+  }
+}
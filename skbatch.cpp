@@ -0,0 +1,381 @@
+//----------------------------------------------------------------------------------------------//
+// FILE: skbatch.cpp                                                                            //
+//                                                                                              //
+// Runs many independent seeded games of the headless simulation across all cores as fast as   //
+// possible and reports the throughput (games/s, ticks/s) and the distribution of scores.       //
+// Game n is seeded with seed + n, so a batch gives the same results on any number of threads.  //
+//                                                                                              //
+// usage: skbatch [-games <n>] [-threads <n>] [-seed <n>] [-world <n>] [-wide <n>] [-scaling]   //
+//                [-autopilot] [-mcts <n>]                                                      //
+//                                                                                              //
+//   -games      number of games to run (default 10000).                                        //
+//   -threads    number of worker threads (default all cores).                                  //
+//   -seed       seed of the first game (default 1).                                            //
+//   -world      width and height of the (square) world in cells (default 50).                  //
+//   -wide       play n games in lockstep per thread with a WideSimulation (default 0; each    //
+//               game is played alone with a Simulation). Results are the same either way.      //
+//   -scaling    run the batch on 1, 2, 4 ... up to the number of threads and report each.      //
+//   -autopilot  play with the Autopilot (path finding) rather than the greedy baseline, and    //
+//               report its decisions/s and planning times. Not with -wide.                     //
+//   -mcts       play with the MctsBot making n rollouts per move, searching on all threads;   //
+//               games are played one at a time. Reports rollouts/s (with -scaling, on 1, 2,   //
+//               4 ... threads). Not with -wide or -autopilot.                                  //
+//----------------------------------------------------------------------------------------------//
+
+#define SK_SIM_ONLY
+#include "snake.cpp"
+
+namespace batch
+{
+
+using Clock_t = std::chrono::steady_clock;
+
+constexpr int maxStepsPerCell {64};   // games are cut off after this many steps per world cell.
+constexpr int gamesPerClaim {16};     // games a worker claims at a time.
+
+struct Config
+{
+  int _numGames;
+  int _numThreads;
+  uint32_t _seed;
+  int _worldSize;
+  int _numLanes;                      // games played in lockstep per thread; 0 to play singly.
+  bool _isAutopilotOn;
+  int _numRolloutsPerMove;            // if not 0 games are played by the MctsBot.
+};
+
+struct Result
+{
+  int _score;
+  int64_t _numSteps;
+  sk::Simulation::State _state;       // STATE_PLAYING if the game was cut off.
+};
+
+// Steers toward the food by the shortest (wrapped) distance among the moves which are not
+// blocked; a simple baseline player so games end in a realistic number of steps.
+template<typename IsBlocked_t>
+sk::Snake::MoveDirection chooseDirection(sk::Vector2i head, sk::Vector2i food, sk::Vector2i dimensions,
+                                         sk::Snake::MoveDirection direction, IsBlocked_t isBlocked)
+{
+  static constexpr std::array<sk::Vector2i, 4> deltas {{{0, 1}, {0, -1}, {1, 0}, {-1, 0}}};
+
+  auto wrappedDistance = [](int a, int b, int size){
+    int d = std::abs(a - b);
+    return std::min(d, size - d);
+  };
+
+  sk::Snake::MoveDirection best = direction;
+  int bestDistance = std::numeric_limits<int>::max();
+  for(auto candidate : {sk::Snake::NORTH, sk::Snake::SOUTH, sk::Snake::EAST, sk::Snake::WEST}){
+    if(isBlocked(candidate))
+      continue;
+    sk::Vector2i next = head + deltas[candidate];
+    int distance = wrappedDistance(next._x, food._x, dimensions._x) +
+                   wrappedDistance(next._y, food._y, dimensions._y);
+    if(distance < bestDistance){
+      best = candidate;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+int64_t getMaxSteps(const sk::Simulation::Config& config)
+{
+  return static_cast<int64_t>(maxStepsPerCell) * config._worldDimensions._x * 
+         config._worldDimensions._y;
+}
+
+sk::Snake::MoveDirection chooseDirection(const sk::Simulation& simulation)
+{
+  const sk::Snake& snake = simulation.getSnake();
+  return chooseDirection(
+    snake.getHeadPosition(), snake.toPosition(simulation.getFoodCell()), 
+    snake.getWorldDimensions(), snake.getMoveDirection(),
+    [&snake](sk::Snake::MoveDirection d){return snake.isMoveBlocked(d);}
+  );
+}
+
+// Plays a game with a player which chooses each move given the simulation.
+template<typename Player_t>
+Result playGame(const sk::Simulation::Config& config, uint32_t seed, Player_t player)
+{
+  sk::Simulation simulation {config, seed};
+  int64_t maxSteps = getMaxSteps(config);
+  while(simulation.getState() == sk::Simulation::STATE_PLAYING &&
+        simulation.getNumSteps() < maxSteps){
+    simulation.setMoveDirection(player(simulation));
+    simulation.step();
+  }
+  return Result{simulation.getScore(), simulation.getNumSteps(), simulation.getState()};
+}
+
+// Plays games one at a time, claiming them in blocks, until all games are claimed.
+void playGames(const Config& config, const sk::Simulation::Config& simulationConfig,
+               std::atomic<int>& nextGameNo, std::vector<Result>& results, 
+               sk::Autopilot::Stats& autopilotStats)
+{
+  std::unique_ptr<sk::Autopilot> autopilot {};
+  if(config._isAutopilotOn)
+    autopilot = std::make_unique<sk::Autopilot>(simulationConfig._worldDimensions);
+  while(true){
+    int gameNo0 = nextGameNo.fetch_add(gamesPerClaim, std::memory_order_relaxed);
+    if(gameNo0 >= config._numGames)
+      break;
+    int gameNo1 = std::min(gameNo0 + gamesPerClaim, config._numGames);
+    for(int gameNo = gameNo0; gameNo < gameNo1; ++gameNo){
+      uint32_t seed = config._seed + gameNo;
+      if(autopilot){
+        autopilot->reset();
+        results[gameNo] = playGame(simulationConfig, seed, [&autopilot](const sk::Simulation& s){
+          return autopilot->decide(s);
+        });
+      }
+      else
+        results[gameNo] = playGame(simulationConfig, seed, 
+                                   [](const sk::Simulation& s){return chooseDirection(s);});
+    }
+  }
+  if(autopilot)
+    autopilotStats = autopilot->getStats();
+}
+
+// Plays games in the lanes of a wide simulation; as each game ends its lane is restarted with 
+// the next unclaimed game, until all games are claimed.
+void playGamesWide(const Config& config, const sk::Simulation::Config& simulationConfig,
+                   std::atomic<int>& nextGameNo, std::vector<Result>& results)
+{
+  sk::WideSimulation wide {simulationConfig, config._numLanes, 0};
+  std::vector<int> laneGameNos(config._numLanes, -1);
+  int64_t maxSteps = getMaxSteps(simulationConfig);
+  int numPlaying {0};
+
+  auto claimGame = [&](int laneNo){
+    int gameNo = nextGameNo.fetch_add(1, std::memory_order_relaxed);
+    if(gameNo >= config._numGames){
+      wide.stop(laneNo);
+      laneGameNos[laneNo] = -1;
+      return false;
+    }
+    wide.restart(laneNo, config._seed + gameNo);
+    laneGameNos[laneNo] = gameNo;
+    return true;
+  };
+
+  for(int laneNo = 0; laneNo < config._numLanes; ++laneNo)
+    numPlaying += claimGame(laneNo) ? 1 : 0;
+
+  while(numPlaying > 0){
+    wide.updateBlockedMoves();
+    for(int laneNo = 0; laneNo < config._numLanes; ++laneNo){
+      if(laneGameNos[laneNo] == -1)
+        continue;
+      sk::Snake::MoveDirection direction = chooseDirection(
+        wide.getHeadPosition(laneNo), wide.toPosition(wide.getFoodCell(laneNo)), 
+        wide.getWorldDimensions(), wide.getMoveDirection(laneNo),
+        [&wide, laneNo](sk::Snake::MoveDirection d){return (wide.getBlockedMoves(laneNo) >> d) & 1;}
+      );
+      wide.setMoveDirection(laneNo, direction);
+    }
+    wide.step();
+    for(int laneNo = 0; laneNo < config._numLanes; ++laneNo){
+      int gameNo = laneGameNos[laneNo];
+      if(gameNo == -1)
+        continue;
+      if(wide.getState(laneNo) == sk::Simulation::STATE_PLAYING && wide.getNumSteps(laneNo) < maxSteps)
+        continue;
+      results[gameNo] = Result{wide.getScore(laneNo), wide.getNumSteps(laneNo), wide.getState(laneNo)};
+      numPlaying -= claimGame(laneNo) ? 0 : 1;
+    }
+  }
+}
+
+// Plays all games one at a time with an MctsBot which searches on all threads.
+void playGamesMcts(const Config& config, const sk::Simulation::Config& simulationConfig,
+                   std::vector<Result>& results, sk::MctsBot::Stats& mctsStats)
+{
+  sk::MctsBot::Config mctsConfig {sk::MctsBot::defaultConfig};
+  mctsConfig._numThreads = config._numThreads;
+  mctsConfig._numRolloutsPerMove = config._numRolloutsPerMove;
+  mctsConfig._seed = config._seed;
+  sk::MctsBot bot {simulationConfig._worldDimensions, mctsConfig};
+  for(int gameNo = 0; gameNo < config._numGames; ++gameNo){
+    results[gameNo] = playGame(simulationConfig, config._seed + gameNo, [&bot](const sk::Simulation& s){
+      return bot.decide(s);
+    });
+  }
+  mctsStats = bot.getStats();
+}
+
+// Runs all games of a batch on a pool of workers. Each worker claims games from a shared counter
+// and writes each result (and its autopilot stats) to its own slot, so workers share nothing 
+// else.
+double runBatch(const Config& config, std::vector<Result>& results, 
+                std::vector<sk::Autopilot::Stats>& autopilotStats, sk::MctsBot::Stats& mctsStats)
+{
+  sk::Simulation::Config simulationConfig {
+    sk::Vector2i{config._worldSize, config._worldSize}, 4, 1
+  };
+  results.resize(config._numGames);
+  autopilotStats.assign(config._numThreads, sk::Autopilot::Stats{});
+  std::atomic<int> nextGameNo {0};
+
+  auto now0 = Clock_t::now();
+  if(config._numRolloutsPerMove > 0)
+    playGamesMcts(config, simulationConfig, results, mctsStats);   // the bot has its own threads.
+  else{
+    sk::WorkerPool workers {config._numThreads};
+    for(int i = 0; i < config._numThreads; ++i){
+      workers.submit([&, i](){
+        if(config._numLanes > 0)
+          playGamesWide(config, simulationConfig, nextGameNo, results);
+        else
+          playGames(config, simulationConfig, nextGameNo, results, autopilotStats[i]);
+      });
+    }
+  } // the pool finishes all jobs before it is destroyed.
+  return std::chrono::duration<double>(Clock_t::now() - now0).count();
+}
+
+void reportBatch(const Config& config, const std::vector<Result>& results, 
+                 const std::vector<sk::Autopilot::Stats>& autopilotStats, 
+                 const sk::MctsBot::Stats& mctsStats, double duration_s)
+{
+  std::vector<int> scores {};
+  int64_t numSteps {0};
+  int numDead {0}, numWon {0}, numCutOff {0};
+  for(const auto& result : results){
+    scores.push_back(result._score);
+    numSteps += result._numSteps;
+    numDead += (result._state == sk::Simulation::STATE_DEAD) ? 1 : 0;
+    numWon += (result._state == sk::Simulation::STATE_WON) ? 1 : 0;
+    numCutOff += (result._state == sk::Simulation::STATE_PLAYING) ? 1 : 0;
+  }
+  std::sort(scores.begin(), scores.end());
+
+  double mean {0.0}, variance {0.0};
+  for(int score : scores)
+    mean += score;
+  mean /= scores.size();
+  for(int score : scores)
+    variance += (score - mean) * (score - mean);
+  variance /= scores.size();
+
+  auto percentile = [&scores](int p){return scores[(scores.size() - 1) * p / 100];};
+
+  std::cout << std::fixed << std::setprecision(1)
+            << "threads: " << config._numThreads
+            << " lanes: " << config._numLanes
+            << " games: " << config._numGames
+            << " time (s): " << std::setprecision(3) << duration_s << std::setprecision(1)
+            << " games/s: " << config._numGames / duration_s
+            << " ticks/s: " << numSteps / duration_s
+            << std::endl
+            << "  score mean: " << mean
+            << " stddev: " << std::sqrt(variance)
+            << " min: " << scores.front()
+            << " p10: " << percentile(10)
+            << " p50: " << percentile(50)
+            << " p90: " << percentile(90)
+            << " max: " << scores.back()
+            << std::endl
+            << "  dead: " << numDead << " won: " << numWon << " cut off: " << numCutOff
+            << std::endl;
+
+  if(config._numRolloutsPerMove > 0){
+    double decisionTime_s = std::chrono::duration<double>(mctsStats._totalDecisionTime).count();
+    decisionTime_s = std::max(decisionTime_s, 1e-9);
+    std::cout << "  mcts moves: " << mctsStats._numDecisions
+              << " rollouts: " << mctsStats._numRollouts
+              << " rollouts/s: " << mctsStats._numRollouts / decisionTime_s
+              << " moves/rollout: " 
+              << static_cast<double>(mctsStats._numRolloutMoves) / std::max(mctsStats._numRollouts, int64_t{1})
+              << " decisions/s: " << mctsStats._numDecisions / decisionTime_s
+              << std::endl;
+  }
+
+  if(!config._isAutopilotOn)
+    return;
+
+  // decisions/s is per thread: decisions over the time spent deciding.
+  sk::Autopilot::Stats total {};
+  for(const auto& stats : autopilotStats){
+    total._numDecisions += stats._numDecisions;
+    total._numPlans += stats._numPlans;
+    total._numUnsafePaths += stats._numUnsafePaths;
+    total._numPartialPaths += stats._numPartialPaths;
+    total._numFallbacks += stats._numFallbacks;
+    total._totalDecisionTime += stats._totalDecisionTime;
+    total._totalPlanTime += stats._totalPlanTime;
+    total._maxPlanTime = std::max(total._maxPlanTime, stats._maxPlanTime);
+  }
+  auto toSeconds = [](sk::Autopilot::Duration_t d){return std::chrono::duration<double>(d).count();};
+  std::cout << "  autopilot decisions: " << total._numDecisions
+            << " plans: " << total._numPlans
+            << " unsafe paths: " << total._numUnsafePaths
+            << " partial paths: " << total._numPartialPaths
+            << " fallbacks: " << total._numFallbacks
+            << " decisions/s: " << total._numDecisions / std::max(toSeconds(total._totalDecisionTime), 1e-9)
+            << std::setprecision(3)
+            << " plan mean (us): " << toSeconds(total._totalPlanTime) * 1e6 / std::max(total._numPlans, int64_t{1})
+            << " plan max (us): " << toSeconds(total._maxPlanTime) * 1e6
+            << std::endl;
+}
+
+}; // namespace batch
+
+int main(int argc, char** argv)
+{
+  batch::Config config {10000, static_cast<int>(std::thread::hardware_concurrency()), 1, 50, 0, false, 0};
+  config._numThreads = std::max(config._numThreads, 1);
+  bool isScaling {false};
+  for(int i = 1; i < argc; ++i){
+    if(strcmp(argv[i], "-games") == 0 && i + 1 < argc)
+      config._numGames = std::max(1L, strtol(argv[++i], nullptr, 10));
+    else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+      config._numThreads = std::max(1L, strtol(argv[++i], nullptr, 10));
+    else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+      config._seed = strtoul(argv[++i], nullptr, 10);
+    else if(strcmp(argv[i], "-world") == 0 && i + 1 < argc)
+      config._worldSize = std::clamp(strtol(argv[++i], nullptr, 10), 8L, 4096L);
+    else if(strcmp(argv[i], "-wide") == 0 && i + 1 < argc)
+      config._numLanes = std::clamp(strtol(argv[++i], nullptr, 10), 0L, 4096L);
+    else if(strcmp(argv[i], "-scaling") == 0)
+      isScaling = true;
+    else if(strcmp(argv[i], "-autopilot") == 0)
+      config._isAutopilotOn = true;
+    else if(strcmp(argv[i], "-mcts") == 0 && i + 1 < argc)
+      config._numRolloutsPerMove = std::clamp(strtol(argv[++i], nullptr, 10), 1L, 1L << 24);
+    else{
+      std::cerr << "usage: skbatch [-games <n>] [-threads <n>] [-seed <n>] [-world <n>] [-wide <n>] "
+                   "[-scaling] [-autopilot] [-mcts <n>]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if(config._isAutopilotOn && config._numLanes > 0){
+    std::cerr << "-autopilot cannot be used with -wide" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if(config._numRolloutsPerMove > 0 && (config._numLanes > 0 || config._isAutopilotOn)){
+    std::cerr << "-mcts cannot be used with -wide or -autopilot" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<batch::Result> results {};
+  std::vector<sk::Autopilot::Stats> autopilotStats {};
+  sk::MctsBot::Stats mctsStats {};
+  if(!isScaling){
+    double duration_s = batch::runBatch(config, results, autopilotStats, mctsStats);
+    batch::reportBatch(config, results, autopilotStats, mctsStats, duration_s);
+    return EXIT_SUCCESS;
+  }
+
+  int maxThreads = config._numThreads;
+  for(int numThreads = 1; ; numThreads = std::min(numThreads * 2, maxThreads)){
+    config._numThreads = numThreads;
+    double duration_s = batch::runBatch(config, results, autopilotStats, mctsStats);
+    batch::reportBatch(config, results, autopilotStats, mctsStats, duration_s);
+    if(numThreads == maxThreads)
+      break;
+  }
+}
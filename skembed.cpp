@@ -0,0 +1,101 @@
+//----------------------------------------------------------------------------------------------//
+// FILE: skembed.cpp                                                                            //
+//                                                                                              //
+// Generates a header of constexpr pixel arrays from a directory of bmps so the sprites can be  //
+// compiled into the game; see EmbeddedSprite in snake.cpp.                                     //
+//                                                                                              //
+// usage: skembed <bmp directory> <output header>                                               //
+//----------------------------------------------------------------------------------------------//
+
+#define SK_NO_MAIN
+#include "snake.cpp"
+
+#include <filesystem>
+
+namespace embed
+{
+
+constexpr int pixelsPerLine {8};
+
+struct Sprite
+{
+  std::string _filename;
+  sk::Image _image;
+};
+
+void writePixels(std::ostream& os, int spriteNo, const std::vector<sk::Color4>& pixels)
+{
+  os << "constexpr Color4 embeddedPixels" << spriteNo << "[] {";
+  for(size_t i = 0; i < pixels.size(); ++i){
+    if(i % pixelsPerLine == 0)
+      os << "\n ";
+    const sk::Color4& pixel = pixels[i];
+    os << " {" << static_cast<int>(pixel.getRed()) << "," << static_cast<int>(pixel.getGreen())
+       << "," << static_cast<int>(pixel.getBlue()) << "," << static_cast<int>(pixel.getAlpha())
+       << "},";
+  }
+  os << "\n};\n\n";
+}
+
+}; // namespace embed
+
+int main(int argc, char** argv)
+{
+  if(argc != 3){
+    std::cerr << "usage: skembed <bmp directory> <output header>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string directory {argv[1]};
+  std::string outputFilename {argv[2]};
+
+  std::error_code error {};
+  std::vector<std::string> filenames {};
+  for(auto it = std::filesystem::directory_iterator{directory, error};
+      !error && it != std::filesystem::directory_iterator{}; it.increment(error)){
+    if(it->is_regular_file(error) && it->path().extension() == ".bmp")
+      filenames.push_back(it->path().filename().string());
+  }
+  if(error){
+    std::cerr << "failed to read directory " << directory << " : " << error.message() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // sorted so the generated header does not depend on directory order.
+  std::sort(filenames.begin(), filenames.end());
+
+  std::vector<embed::Sprite> sprites {};
+  for(const auto& filename : filenames){
+    embed::Sprite sprite {filename, sk::Image{}};
+    if(sprite._image.loadBmpMapped(directory + "/" + filename) != 0){
+      std::cerr << "skipping " << filename << " : failed to load bmp" << std::endl;
+      continue;
+    }
+    sprites.push_back(std::move(sprite));
+  }
+
+  std::ofstream os {outputFilename, std::ios_base::trunc};
+  os << "// generated by skembed from the bmps in " << directory << "; do not edit.\n"
+     << "//\n"
+     << "// note: included by snake.cpp within namespace sk.\n\n";
+
+  for(size_t i = 0; i < sprites.size(); ++i)
+    embed::writePixels(os, i, sprites[i]._image.getPixels());
+
+  os << "constexpr std::array<EmbeddedSprite, " << sprites.size() << "> embeddedSprites {{\n";
+  for(size_t i = 0; i < sprites.size(); ++i){
+    os << "  {\"" << sprites[i]._filename << "\", embeddedPixels" << i << ", "
+       << sprites[i]._image.getWidth() << ", " << sprites[i]._image.getHeight() << "},\n";
+  }
+  os << "}};\n";
+
+  if(!os){
+    std::cerr << "failed to write " << outputFilename << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for(const auto& sprite : sprites){
+    std::cout << sprite._filename << " : " << sprite._image.getWidth() << "x"
+              << sprite._image.getHeight() << std::endl;
+  }
+  std::cout << "embedded " << sprites.size() << " sprites into " << outputFilename << std::endl;
+}
@@ -0,0 +1,165 @@
+//----------------------------------------------------------------------------------------------//
+// FILE: skpack.cpp                                                                             //
+//                                                                                              //
+// Packs a directory of bmps into a sprite pack (.skpak) of pre-decoded sprites which the game  //
+// can use straight from a memory mapping; see SPRITE PACK FORMAT in snake.cpp.                 //
+//                                                                                              //
+// usage: skpack [-rle] <bmp directory> <output file>                                          //
+//                                                                                              //
+//   -rle   run-length-encode sprites which get smaller for it (these are then decoded when     //
+//          loaded rather than used in place).                                                  //
+//----------------------------------------------------------------------------------------------//
+
+#define SK_NO_MAIN
+#include "snake.cpp"
+
+#include <filesystem>
+
+namespace pack
+{
+
+struct Sprite
+{
+  sk::SpritePackEntry _entry;
+  std::vector<uint8_t> _block;
+};
+
+void encodeRaw(const std::vector<sk::Color4>& pixels, std::vector<uint8_t>& block)
+{
+  block.resize(pixels.size() * sizeof(sk::Color4));
+  memcpy(block.data(), pixels.data(), block.size());
+}
+
+void encodeRle(const std::vector<sk::Color4>& pixels, std::vector<uint8_t>& block)
+{
+  std::vector<sk::SpritePackRun> runs {};
+  for(const auto& pixel : pixels){
+    if(!runs.empty() && memcmp(&runs.back()._color, &pixel, sizeof(sk::Color4)) == 0 &&
+       runs.back()._count != UINT32_MAX)
+      ++runs.back()._count;
+    else
+      runs.push_back(sk::SpritePackRun{1, pixel});
+  }
+  block.resize(runs.size() * sizeof(sk::SpritePackRun));
+  memcpy(block.data(), runs.data(), block.size());
+}
+
+uint64_t alignUp(uint64_t offset)
+{
+  return ((offset + sk::spritePackAlignment - 1) / sk::spritePackAlignment) * sk::spritePackAlignment;
+}
+
+}; // namespace pack
+
+int main(int argc, char** argv)
+{
+  bool isRle {false};
+  int argNo {1};
+  if(argc > argNo && strcmp(argv[argNo], "-rle") == 0){
+    isRle = true;
+    ++argNo;
+  }
+  if(argc - argNo != 2){
+    std::cerr << "usage: skpack [-rle] <bmp directory> <output file>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string directory {argv[argNo]};
+  std::string outputFilename {argv[argNo + 1]};
+
+  if(!sk::isSystemLittleEndian()){
+    std::cerr << "sprite packs can only be built on little-endian systems" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::error_code error {};
+  std::vector<std::string> filenames {};
+  for(auto it = std::filesystem::directory_iterator{directory, error}; 
+      !error && it != std::filesystem::directory_iterator{}; it.increment(error)){
+    if(it->is_regular_file(error) && it->path().extension() == ".bmp")
+      filenames.push_back(it->path().filename().string());
+  }
+  if(error){
+    std::cerr << "failed to read directory " << directory << " : " << error.message() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // entries must be sorted by name for the reader's binary search.
+  std::sort(filenames.begin(), filenames.end(), [](const std::string& a, const std::string& b){
+    return strcmp(a.c_str(), b.c_str()) < 0;
+  });
+
+  std::vector<pack::Sprite> sprites {};
+  for(const auto& filename : filenames){
+    if(filename.size() > sk::SpritePackEntry::maxNameLength){
+      std::cerr << "skipping " << filename << " : name too long" << std::endl;
+      continue;
+    }
+
+    sk::Image image {};
+    if(image.loadBmpMapped(directory + "/" + filename) != 0){
+      std::cerr << "skipping " << filename << " : failed to load bmp" << std::endl;
+      continue;
+    }
+    if(static_cast<uint32_t>(image.getWidth()) > sk::SpritePackEntry::maxDimension_px || 
+       static_cast<uint32_t>(image.getHeight()) > sk::SpritePackEntry::maxDimension_px){
+      std::cerr << "skipping " << filename << " : too large to pack" << std::endl;
+      continue;
+    }
+
+    pack::Sprite sprite {};
+    memset(&sprite._entry, 0, sizeof(sk::SpritePackEntry));
+    strncpy(sprite._entry._name, filename.c_str(), sk::SpritePackEntry::maxNameLength);
+    sprite._entry._width_px = image.getWidth();
+    sprite._entry._height_px = image.getHeight();
+    sprite._entry._compression = sk::SpritePackEntry::COMPRESSION_NONE;
+    pack::encodeRaw(image.getPixels(), sprite._block);
+
+    if(isRle){
+      std::vector<uint8_t> rleBlock {};
+      pack::encodeRle(image.getPixels(), rleBlock);
+      if(rleBlock.size() < sprite._block.size()){
+        sprite._block = std::move(rleBlock);
+        sprite._entry._compression = sk::SpritePackEntry::COMPRESSION_RLE;
+      }
+    }
+
+    sprite._entry._size_bytes = sprite._block.size();
+    sprites.push_back(std::move(sprite));
+  }
+
+  uint64_t offset = sizeof(sk::SpritePackHeader) + (sprites.size() * sizeof(sk::SpritePackEntry));
+  for(auto& sprite : sprites){
+    offset = pack::alignUp(offset);
+    sprite._entry._offset_bytes = offset;
+    offset += sprite._block.size();
+  }
+
+  sk::SpritePackHeader header {};
+  header._magic = sk::SpritePackHeader::packMagic;
+  header._version = sk::SpritePackHeader::packVersion;
+  header._numEntries = sprites.size();
+  header._fileSize_bytes = offset;
+
+  std::ofstream os {outputFilename, std::ios_base::binary | std::ios_base::trunc};
+  os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for(const auto& sprite : sprites)
+    os.write(reinterpret_cast<const char*>(&sprite._entry), sizeof(sk::SpritePackEntry));
+  for(const auto& sprite : sprites){
+    uint64_t position = static_cast<uint64_t>(os.tellp());
+    std::vector<char> padding(sprite._entry._offset_bytes - position, 0);
+    os.write(padding.data(), padding.size());
+    os.write(reinterpret_cast<const char*>(sprite._block.data()), sprite._block.size());
+  }
+  if(!os){
+    std::cerr << "failed to write " << outputFilename << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  for(const auto& sprite : sprites){
+    std::cout << sprite._entry._name << " : " << sprite._entry._width_px << "x" 
+              << sprite._entry._height_px << " " 
+              << (sprite._entry._compression == sk::SpritePackEntry::COMPRESSION_RLE ? "rle" : "raw")
+              << " " << sprite._entry._size_bytes << " bytes" << std::endl;
+  }
+  std::cout << "packed " << sprites.size() << " sprites into " << outputFilename << std::endl;
+}
@@ -26,16 +26,38 @@
 #include <algorithm>
 #include <string>
 #include <cstring>
+#include <cstdio>
 #include <sstream>
 #include <cassert>
+#include <cerrno>
 #include <cmath>
 #include <array>
 #include <vector>
 #include <memory>
 #include <fstream>
-
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <deque>
+#include <random>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifndef SK_SIM_ONLY
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_opengl.h>
+#endif
 
 namespace sk
 {
@@ -93,12 +115,71 @@ void Vector2i::normalize()
 
 struct iRect
 {
+  int32_t area() const {return _w * _h;}
+  bool isEmpty() const {return _w <= 0 || _h <= 0;}
+  inline iRect united(const iRect& r) const;
+  inline iRect intersected(const iRect& r) const;
+
   int32_t _x;
   int32_t _y;
   int32_t _w;
   int32_t _h;
 };
 
+// returns the smallest rect containing both rects.
+iRect iRect::united(const iRect& r) const
+{
+  int32_t x0 = std::min(_x, r._x);
+  int32_t y0 = std::min(_y, r._y);
+  int32_t x1 = std::max(_x + _w, r._x + r._w);
+  int32_t y1 = std::max(_y + _h, r._y + r._h);
+  return iRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+// returns the overlap of both rects; empty (zero width and height) if they do not overlap.
+iRect iRect::intersected(const iRect& r) const
+{
+  int32_t x0 = std::max(_x, r._x);
+  int32_t y0 = std::max(_y, r._y);
+  int32_t x1 = std::min(_x + _w, r._x + r._w);
+  int32_t y1 = std::min(_y + _h, r._y + r._h);
+  if(x1 <= x0 || y1 <= y0)
+    return iRect{x0, y0, 0, 0};
+  return iRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+//------------------------------------------------------------------------------------------------
+//  SIMD                                                                                          
+//------------------------------------------------------------------------------------------------
+
+enum SimdLevel { SIMD_NONE, SIMD_SSE41, SIMD_AVX2 };
+
+// Caps the instruction set vectorized code (e.g. the row decoders) may use; useful to compare 
+// vectorized and scalar code or to rule out vectorized code when debugging.
+SimdLevel maxSimdLevel {SIMD_AVX2};
+
+#if defined(__x86_64__) || defined(__i386__)
+
+SimdLevel detectSimdLevel()
+{
+  static const SimdLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2 :
+                                 __builtin_cpu_supports("sse4.1") ? SIMD_SSE41 : SIMD_NONE;
+  return level;
+}
+
+#else
+
+SimdLevel detectSimdLevel()
+{
+  return SIMD_NONE;
+}
+
+#endif
+
+// note: builds which define SK_SIM_ONLY get only the simulation (and what it uses), and so need 
+// neither SDL nor opengl; sections or parts of sections the simulation does not use are excluded.
+#ifndef SK_SIM_ONLY
+
 //------------------------------------------------------------------------------------------------
 //  LOG                                                                                           
 //------------------------------------------------------------------------------------------------
@@ -110,36 +191,129 @@ namespace logstr
   constexpr const char* fail_create_opengl_context = "failed to create opengl context";
   constexpr const char* fail_set_opengl_attribute = "failed to set opengl attribute";
   constexpr const char* fail_create_window = "failed to create window";
+  constexpr const char* fail_load_asset = "failed to load asset";
+  constexpr const char* fail_capture_framebuffer = "failed to capture framebuffer";
+  constexpr const char* fail_make_context_current = "failed to make opengl context current";
+
+  constexpr const char* warn_log_overflow = "log overflow; records dropped";
+  constexpr const char* warn_no_texture_render_mode = "texture render mode unsupported; using points";
+  constexpr const char* warn_no_vsync = "vsync unsupported; using hybrid frame pacing";
+  constexpr const char* warn_unmapped_colors = "sprite colors not in palette; drawn transparent";
 
   constexpr const char* info_stderr_log = "logging to standard error";
+  constexpr const char* info_no_sprite_pack = "no sprite pack; loading assets from bmps";
   constexpr const char* info_creating_window = "creating window";
   constexpr const char* info_created_window = "window created";
   constexpr const char* using_opengl_version = "using opengl version";
+  constexpr const char* info_render_mode = "render mode";
+  constexpr const char* info_software_renderer = "using software renderer";
+  constexpr const char* info_frame_pacing = "frame pacing";
+  constexpr const char* info_frame_pacing_stats = "frame pacing stats";
+  constexpr const char* info_tick_stats = "tick stats";
+  constexpr const char* info_main_thread_stats = "main thread stats";
+  constexpr const char* info_render_thread_stats = "render thread stats";
+  constexpr const char* info_dirty_rect_stats = "dirty rect stats";
+  constexpr const char* info_game_over = "game over";
+  constexpr const char* info_autopilot_stats = "autopilot stats";
 }; 
 
+// The log is asynchronous: calls to log() format a fixed-size record into a bounded ring buffer
+// and return immediately, a background writer thread drains the ring in batches and does all
+// the file I/O. This keeps disk writes (and flushes) off the frame thread.
+//
+// The ring is a multi-producer single-consumer queue; each slot carries a sequence number which
+// producers and the consumer use to hand ownership of the slot back and forth without locks, 
+// see [0]. Producers claim slots with a CAS on the enqueue position, the single writer thread
+// owns the dequeue position outright.
+//
+// When the ring is full the overflow policy decides what happens; DROP discards the record (the
+// number dropped is reported by the writer once space frees up), BLOCK spins (yielding) until 
+// the writer frees a slot.
+//
+// note: fatal records are always followed by a flush since the caller is about to exit.
+//
+// references:
+// [0] https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
 class Log
 {
 public:
   enum Level { FATAL, ERROR, WARN, INFO };
+  enum OverflowPolicy { DROP, BLOCK };
+  struct Config
+  {
+    OverflowPolicy _overflowPolicy;
+    int _writerPeriod_ms;           // max time a record waits in the ring before being written.
+  };
 public:
   Log();
+  Log(const Config& config);
   ~Log();
   Log(const Log&) = delete;
   Log(Log&&) = delete;
   Log& operator=(const Log&) = delete;
   Log& operator=(Log&&) = delete;
-  void log(Level level, const char* error, const std::string& addendum = std::string{});
+  void log(Level level, const char* error, const char* addendum = nullptr);
+  void log(Level level, const char* error, const std::string& addendum);
+  void flush();
+  uint64_t getDroppedCount() const {return _droppedCount.load(std::memory_order_relaxed);}
+private:
+  // fixed-size records so no allocation occurs on the logging path; overlong text is truncated.
+  struct Record
+  {
+    static constexpr int maxTextLength {247};
+
+    Level _level;
+    uint8_t _textLength;
+    char _text[maxTextLength];
+  };
+  struct Slot
+  {
+    std::atomic<uint64_t> _sequence;
+    Record _record;
+  };
 private:
   static constexpr const char* filename {"log"};
   static constexpr const char* delim {" : "};
   static constexpr std::array<const char*, 4> lvlstr {"fatal", "error", "warning", "info"};
+  static constexpr int ringCapacity {1024};                 // must be a power of 2.
+  static constexpr uint64_t ringMask {ringCapacity - 1};
+  static constexpr Config defaultConfig {BLOCK, 5};
 private:
+  bool push(Level level, const char* error, const char* addendum);
+  int drain(std::string& batch);
+  void writerMain();
+private:
+  Config _config;
+  std::unique_ptr<Slot[]> _ring;
+  alignas(64) std::atomic<uint64_t> _enqueuePos;
+  alignas(64) uint64_t _dequeuePos;                     // owned by the writer thread.
+  alignas(64) std::atomic<uint64_t> _writtenPos;        // records written; used by flush().
+  std::atomic<uint64_t> _droppedCount;
+  std::atomic<bool> _isDone;
+  std::mutex _wakeMutex;
+  std::condition_variable _wakeCondition;
   std::ofstream _os;
+  std::thread _writer;
 };
 
-Log::Log()
+Log::Log() : Log(defaultConfig)
+{}
+
+Log::Log(const Config& config) :
+  _config{config},
+  _ring{std::make_unique<Slot[]>(ringCapacity)},
+  _enqueuePos{0},
+  _dequeuePos{0},
+  _writtenPos{0},
+  _droppedCount{0},
+  _isDone{false}
 {
+  for(int i = 0; i < ringCapacity; ++i)
+    _ring[i]._sequence.store(i, std::memory_order_relaxed);
+
   _os.open(filename, std::ios_base::trunc);
+  _writer = std::thread{&Log::writerMain, this};
+
   if(!_os){
     log(ERROR, logstr::fail_open_log);
     log(INFO, logstr::info_stderr_log);
@@ -148,17 +322,140 @@ Log::Log()
 
 Log::~Log()
 {
+  _isDone.store(true, std::memory_order_release);
+  _wakeCondition.notify_one();
+  if(_writer.joinable())
+    _writer.join();
   if(_os)
     _os.close();
 }
 
+void Log::log(Level level, const char* error, const char* addendum)
+{
+  while(!push(level, error, addendum)){
+    if(_config._overflowPolicy == DROP){
+      _droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    _wakeCondition.notify_one();
+    std::this_thread::yield();
+  }
+  if(level == FATAL)
+    flush();
+}
+
 void Log::log(Level level, const char* error, const std::string& addendum)
 {
-  std::ostream& o {_os ? _os : std::cerr}; 
-  o << lvlstr[level] << delim << error;
-  if(!addendum.empty())
-    o << delim << addendum;
-  o << std::endl;
+  log(level, error, addendum.empty() ? nullptr : addendum.c_str());
+}
+
+void Log::flush()
+{
+  uint64_t target = _enqueuePos.load(std::memory_order_acquire);
+  while(_writtenPos.load(std::memory_order_acquire) < target){
+    _wakeCondition.notify_one();
+    std::this_thread::yield();
+  }
+}
+
+bool Log::push(Level level, const char* error, const char* addendum)
+{
+  Slot* slot;
+  uint64_t pos = _enqueuePos.load(std::memory_order_relaxed);
+  while(true){
+    slot = &_ring[pos & ringMask];
+    uint64_t sequence = slot->_sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+    if(diff == 0){
+      if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        break;
+    }
+    else if(diff < 0)
+      return false;                                        // ring is full.
+    else
+      pos = _enqueuePos.load(std::memory_order_relaxed);
+  }
+
+  // format the record in place; only the message text is copied, all formatting of the level
+  // string and delimiters is deferred to the writer.
+  Record& record = slot->_record;
+  record._level = level;
+  int length {0};
+  auto append = [&record, &length](const char* str){
+    while(*str != '\0' && length < Record::maxTextLength)
+      record._text[length++] = *str++;
+  };
+  append(error);
+  if(addendum != nullptr && *addendum != '\0'){
+    append(delim);
+    append(addendum);
+  }
+  record._textLength = static_cast<uint8_t>(length);
+
+  slot->_sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+int Log::drain(std::string& batch)
+{
+  int count {0};
+  while(true){
+    Slot& slot = _ring[_dequeuePos & ringMask];
+    uint64_t sequence = slot._sequence.load(std::memory_order_acquire);
+    if(sequence != _dequeuePos + 1)
+      break;                                               // ring is empty.
+
+    const Record& record = slot._record;
+    batch.append(lvlstr[record._level]);
+    batch.append(delim);
+    batch.append(record._text, record._textLength);
+    batch.push_back('\n');
+
+    slot._sequence.store(_dequeuePos + ringCapacity, std::memory_order_release);
+    ++_dequeuePos;
+    ++count;
+  }
+  return count;
+}
+
+void Log::writerMain()
+{
+  std::string batch {};
+  batch.reserve(ringCapacity * (Record::maxTextLength + 16));
+  uint64_t droppedReported {0};
+  while(true){
+    bool isDone = _isDone.load(std::memory_order_acquire);
+
+    batch.clear();
+    int count = drain(batch);
+
+    uint64_t dropped = _droppedCount.load(std::memory_order_relaxed);
+    if(dropped != droppedReported){
+      batch.append(lvlstr[WARN]);
+      batch.append(delim);
+      batch.append(logstr::warn_log_overflow);
+      batch.append(delim);
+      batch.append(std::to_string(dropped - droppedReported));
+      batch.push_back('\n');
+      droppedReported = dropped;
+    }
+
+    if(!batch.empty()){
+      std::ostream& o {_os ? _os : std::cerr}; 
+      o.write(batch.data(), batch.size());
+      o.flush();
+    }
+    _writtenPos.fetch_add(count, std::memory_order_release);
+
+    // the final drain happens after _isDone is seen so no records are lost on shutdown.
+    if(isDone)
+      break;
+
+    if(count == 0){
+      std::unique_lock<std::mutex> lock {_wakeMutex};
+      _wakeCondition.wait_for(lock, std::chrono::milliseconds{_config._writerPeriod_ms});
+    }
+  }
 }
 
 std::unique_ptr<Log> log {nullptr};
@@ -303,6 +600,8 @@ public:
   uint8_t getGreen() const {return _g;}
   uint8_t getBlue() const {return _b;}
   uint8_t getAlpha() const {return _a;}
+  bool operator==(const Color4& c) const {return _r == c._r && _g == c._g && _b == c._b && _a == c._a;}
+  bool operator!=(const Color4& c) const {return !(*this == c);}
   float getfRed() const {return std::clamp(_r / 255.f, f_lo, f_hi);}    // clamp to cut-off float math errors.
   float getfGreen() const {return std::clamp(_g / 255.f, f_lo, f_hi);}
   float getfBlue() const {return std::clamp(_b / 255.f, f_lo, f_hi);}
@@ -339,14 +638,45 @@ constexpr Color4 gainsboro {224, 224, 224};
 constexpr Color4 jet {53, 53, 53};
 };
 
+// The renderer supports two ways of getting the virtual screen onto the window:
+//
+//   RENDER_POINTS  - the screen's pixels are drawn as an array of scaled GL_POINTS, see 
+//                    drawPixelArray. The point positions only change when the window is resized 
+//                    so are kept in a vertex buffer object (VBO), see setPixelPositions; only the
+//                    colors are sent each frame.
+//
+//   RENDER_TEXTURE - only the screen's colors are streamed into a texture, which is then drawn
+//                    as a single scaled quad, see mapScreenTexture and drawScreenTexture. The
+//                    colors are written to one of two pixel buffer objects (PBOs) in turn so the
+//                    upload to the texture can proceed asynchronously while the next frame's
+//                    colors are written.
+//
+// Texture mode needs the opengl 2.1 buffer object functions; if they are unavailable the 
+// renderer falls back to points mode.
+//
+// The backend is selected at construction:
+//
+//   BACKEND_OPENGL   - draws to an SDL window with an opengl 2.1 context.
+//
+//   BACKEND_SOFTWARE - creates no window or context; all drawing is rasterized on the cpu into an
+//                      in-memory RGBA framebuffer with the same layout and coordinate system as
+//                      the window (origin bottom left). The framebuffer can be read, hashed and
+//                      captured to file, see getFramebuffer, hashFramebuffer and 
+//                      captureFramebuffer. Both render modes are supported, so the draw paths 
+//                      can be run and measured on machines with no gpu or display.
+//
 class Renderer
 {
 public:
+  enum RenderMode { RENDER_POINTS, RENDER_TEXTURE };
+  enum Backend { BACKEND_OPENGL, BACKEND_SOFTWARE };
   struct Config
   {
     std::string _windowTitle;
     int32_t _windowWidth;
     int32_t _windowHeight;
+    RenderMode _renderMode;
+    Backend _backend;
   };
 public:
   Renderer(const Config& config);
@@ -354,28 +684,99 @@ public:
   Renderer* operator=(const Renderer&) = delete;
   ~Renderer();
   void setViewport(iRect viewport);
+  void setRenderMode(RenderMode mode);
+  RenderMode getRenderMode() const {return _renderMode;}
+  bool isRenderModeSupported(RenderMode mode) const {return mode == RENDER_POINTS || _hasBufferFunctions || isSoftware();}
   void clearWindow(const Color4& color);
   void clearViewport(const Color4& color);
-  void drawPixelArray(int first, int count, void* pixels, int pixelSize);
+  void setPixelPositions(const float* positions, int count);
+  void drawPixelArray(int first, int count, const Color4* colors, int pixelSize);
+  Color4* mapScreenTexture(int width, int height);
+  void drawScreenTexture(iRect destination, const iRect* regions, int numRegions);
+  bool isScreenTextureValid() const {return _isScreenTextureValid;}
   void show();
+  void makeContextCurrent(bool isCurrent);
+  int setSwapInterval(int interval);
+  int getRefreshRate() const;
   Vector2i getWindowSize() const;
+  Backend getBackend() const {return _config._backend;}
+  const Color4* getFramebuffer() const {return _framebuffer.data();}
+  uint64_t hashFramebuffer() const;
+  int captureFramebuffer(const std::string& filename) const;
+private:
+  bool isSoftware() const {return _config._backend == BACKEND_SOFTWARE;}
+  void fillFramebuffer(iRect region, const Color4& color);
+  void drawFramebufferTexture(iRect destination);
+  bool loadBufferFunctions();
+  void createScreenTexture(int width, int height);
+  void destroyScreenTexture();
+  void destroyPositionBuffer();
 private:
   static constexpr int openglVersionMajor = 2;
   static constexpr int openglVersionMinor = 1;
+  static constexpr int numScreenBuffers = 2;
 private:
   SDL_Window* _window;
   SDL_GLContext _glContext;
   Config _config;
   iRect _viewport;
+  RenderMode _renderMode;
+
+  // buffer object functions (opengl 2.1); loaded at runtime as they are not exported by all
+  // opengl libraries.
+  PFNGLGENBUFFERSPROC _glGenBuffers;
+  PFNGLDELETEBUFFERSPROC _glDeleteBuffers;
+  PFNGLBINDBUFFERPROC _glBindBuffer;
+  PFNGLBUFFERDATAPROC _glBufferData;
+  PFNGLMAPBUFFERPROC _glMapBuffer;
+  PFNGLUNMAPBUFFERPROC _glUnmapBuffer;
+  bool _hasBufferFunctions;
+
+  GLuint _screenTexture;
+  std::array<GLuint, numScreenBuffers> _screenBuffers;
+  int _screenBufferNo;
+  Vector2i _screenTextureSize;
+  std::vector<Color4> _screenStaging;    // used if a screen buffer cannot be mapped.
+  bool _isScreenBufferMapped;
+  bool _isScreenTextureValid;            // false until the whole texture has been uploaded.
+
+  GLuint _positionBuffer;
+  std::vector<float> _positionStaging;   // used if there are no buffer functions.
+  int _numPositions;
+
+  std::vector<Color4> _framebuffer;      // software backend only; accessed (x + (y * width)).
+  Vector2i _framebufferSize;
 };
 
 Renderer::Renderer(const Config& config)
 {
   _config = config;
 
-  std::stringstream ss {};
-  ss << "{w:" << _config._windowWidth << ",h:" << _config._windowHeight << "}";
-  sk::log->log(Log::INFO, logstr::info_creating_window, std::string{ss.str()});
+  _screenTexture = 0;
+  _screenBuffers.fill(0);
+  _screenBufferNo = 0;
+  _screenTextureSize = Vector2i{0, 0};
+  _isScreenBufferMapped = false;
+  _isScreenTextureValid = false;
+  _positionBuffer = 0;
+  _numPositions = 0;
+  _framebufferSize = Vector2i{0, 0};
+
+  if(isSoftware()){
+    sk::log->log(Log::INFO, logstr::info_software_renderer);
+    _window = nullptr;
+    _glContext = nullptr;
+    _hasBufferFunctions = false;
+    _framebufferSize = Vector2i{_config._windowWidth, _config._windowHeight};
+    _framebuffer.resize(_framebufferSize._x * _framebufferSize._y);
+    setRenderMode(_config._renderMode);
+    setViewport(iRect{0, 0, _config._windowWidth, _config._windowHeight});
+    return;
+  }
+
+  char addendum[32];
+  snprintf(addendum, sizeof(addendum), "{w:%d,h:%d}", _config._windowWidth, _config._windowHeight);
+  sk::log->log(Log::INFO, logstr::info_creating_window, addendum);
 
   _window = SDL_CreateWindow(
       _config._windowTitle.c_str(), 
@@ -387,60 +788,135 @@ Renderer::Renderer(const Config& config)
   );
 
   if(_window == nullptr){
-    sk::log->log(Log::FATAL, logstr::fail_create_window, std::string{SDL_GetError()});
+    sk::log->log(Log::FATAL, logstr::fail_create_window, SDL_GetError());
     exit(EXIT_FAILURE);
   }
 
   Vector2i windowSize = getWindowSize();
-  std::stringstream().swap(ss);
-  ss << "{w:" << windowSize._x << ",h:" << windowSize._y << "}";
-  sk::log->log(Log::INFO, logstr::info_created_window, std::string{ss.str()});
+  snprintf(addendum, sizeof(addendum), "{w:%d,h:%d}", windowSize._x, windowSize._y);
+  sk::log->log(Log::INFO, logstr::info_created_window, addendum);
 
   _glContext = SDL_GL_CreateContext(_window);
   if(_glContext == nullptr){
-    sk::log->log(Log::FATAL, logstr::fail_create_opengl_context, std::string{SDL_GetError()});
+    sk::log->log(Log::FATAL, logstr::fail_create_opengl_context, SDL_GetError());
     exit(EXIT_FAILURE);
   }
 
   if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, openglVersionMajor) < 0){
-    sk::log->log(Log::FATAL, logstr::fail_set_opengl_attribute, std::string{SDL_GetError()});
+    sk::log->log(Log::FATAL, logstr::fail_set_opengl_attribute, SDL_GetError());
     exit(EXIT_FAILURE);
   }
   if(SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, openglVersionMinor) < 0){
-    sk::log->log(Log::FATAL, logstr::fail_set_opengl_attribute, std::string{SDL_GetError()});
+    sk::log->log(Log::FATAL, logstr::fail_set_opengl_attribute, SDL_GetError());
     exit(EXIT_FAILURE);
   }
 
-  sk::log->log(Log::INFO, logstr::using_opengl_version, std::string{reinterpret_cast<const char*>(glGetString(GL_VERSION))});
+  sk::log->log(Log::INFO, logstr::using_opengl_version, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+  _hasBufferFunctions = loadBufferFunctions();
 
+  setRenderMode(_config._renderMode);
   setViewport(iRect{0, 0, _config._windowWidth, _config._windowHeight});
 }
 
 Renderer::~Renderer()
 {
+  if(isSoftware())
+    return;
+  destroyScreenTexture();
+  destroyPositionBuffer();
   SDL_GL_DeleteContext(_glContext);
   SDL_DestroyWindow(_window);
 }
 
+bool Renderer::loadBufferFunctions()
+{
+  _glGenBuffers = reinterpret_cast<PFNGLGENBUFFERSPROC>(SDL_GL_GetProcAddress("glGenBuffers"));
+  _glDeleteBuffers = reinterpret_cast<PFNGLDELETEBUFFERSPROC>(SDL_GL_GetProcAddress("glDeleteBuffers"));
+  _glBindBuffer = reinterpret_cast<PFNGLBINDBUFFERPROC>(SDL_GL_GetProcAddress("glBindBuffer"));
+  _glBufferData = reinterpret_cast<PFNGLBUFFERDATAPROC>(SDL_GL_GetProcAddress("glBufferData"));
+  _glMapBuffer = reinterpret_cast<PFNGLMAPBUFFERPROC>(SDL_GL_GetProcAddress("glMapBuffer"));
+  _glUnmapBuffer = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(SDL_GL_GetProcAddress("glUnmapBuffer"));
+  return _glGenBuffers && _glDeleteBuffers && _glBindBuffer && _glBufferData && _glMapBuffer && 
+         _glUnmapBuffer;
+}
+
+void Renderer::setRenderMode(RenderMode mode)
+{
+  if(mode == RENDER_TEXTURE && !_hasBufferFunctions && !isSoftware()){
+    sk::log->log(Log::WARN, logstr::warn_no_texture_render_mode);
+    mode = RENDER_POINTS;
+  }
+  _renderMode = mode;
+  _isScreenTextureValid = false;
+  sk::log->log(Log::INFO, logstr::info_render_mode, (mode == RENDER_TEXTURE) ? "texture" : "points");
+}
+
+void Renderer::createScreenTexture(int width, int height)
+{
+  destroyScreenTexture();
+
+  glGenTextures(1, &_screenTexture);
+  glBindTexture(GL_TEXTURE_2D, _screenTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  _glGenBuffers(numScreenBuffers, _screenBuffers.data());
+  for(GLuint buffer : _screenBuffers){
+    _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    _glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * sizeof(Color4), nullptr, GL_STREAM_DRAW);
+  }
+  _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  _screenStaging.resize(width * height);
+  _screenTextureSize = Vector2i{width, height};
+  _isScreenTextureValid = false;
+}
+
+void Renderer::destroyScreenTexture()
+{
+  if(_screenTexture == 0)
+    return;
+  glDeleteTextures(1, &_screenTexture);
+  _glDeleteBuffers(numScreenBuffers, _screenBuffers.data());
+  _screenTexture = 0;
+  _screenBuffers.fill(0);
+  _screenTextureSize = Vector2i{0, 0};
+}
+
 void Renderer::setViewport(iRect viewport)
 {
+  _viewport = viewport;
+  if(isSoftware())
+    return;
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
   glOrtho(0.0, viewport._w, 0.0, viewport._h, -1.0, 1.0);
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
   glViewport(viewport._x, viewport._y, viewport._w, viewport._h);
-  _viewport = viewport;
 }
 
 void Renderer::clearWindow(const Color4& color)
 {
+  if(isSoftware()){
+    std::fill(_framebuffer.begin(), _framebuffer.end(), color);
+    return;
+  }
   glClearColor(color.getfRed(), color.getfGreen(), color.getfBlue(), color.getfAlpha());
   glClear(GL_COLOR_BUFFER_BIT);
 }
 
 void Renderer::clearViewport(const Color4& color)
 {
+  if(isSoftware()){
+    fillFramebuffer(iRect{0, 0, _viewport._w, _viewport._h}, color);
+    return;
+  }
   glEnable(GL_SCISSOR_TEST);
   glScissor(_viewport._x, _viewport._y, _viewport._w, _viewport._h);
   glClearColor(color.getfRed(), color.getfGreen(), color.getfBlue(), color.getfAlpha());
@@ -448,27 +924,340 @@ void Renderer::clearViewport(const Color4& color)
   glDisable(GL_SCISSOR_TEST);
 }
 
-void Renderer::drawPixelArray(int first, int count, void* pixels, int pixelSize)
+// Sets the (x, y) window positions of the points drawn by drawPixelArray; positions is a tightly
+// packed array of count pairs. The positions are copied so need only be set again when they 
+// change.
+void Renderer::setPixelPositions(const float* positions, int count)
+{
+  if(!_hasBufferFunctions || isSoftware()){
+    _positionStaging.assign(positions, positions + (count * 2));
+    _numPositions = count;
+    return;
+  }
+  if(_positionBuffer == 0)
+    _glGenBuffers(1, &_positionBuffer);
+  _glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+  _glBufferData(GL_ARRAY_BUFFER, count * 2 * sizeof(float), positions, GL_STATIC_DRAW);
+  _glBindBuffer(GL_ARRAY_BUFFER, 0);
+  _numPositions = count;
+}
+
+void Renderer::destroyPositionBuffer()
+{
+  if(_positionBuffer == 0)
+    return;
+  _glDeleteBuffers(1, &_positionBuffer);
+  _positionBuffer = 0;
+  _numPositions = 0;
+}
+
+// Draws count points, starting from the first, at the positions last set by setPixelPositions 
+// with the matching (tightly packed) colors.
+void Renderer::drawPixelArray(int first, int count, const Color4* colors, int pixelSize)
 {
-  glInterleavedArrays(GL_C4UB_V2F, 0, pixels);
+  assert(first + count <= _numPositions);
+
+  // points are rasterized as squares of side pixelSize centered on their positions.
+  if(isSoftware()){
+    int centerOffset = pixelSize / 2;
+    for(int i = first; i < first + count; ++i){
+      int x = static_cast<int>(_positionStaging[i * 2]) - centerOffset;
+      int y = static_cast<int>(_positionStaging[(i * 2) + 1]) - centerOffset;
+      fillFramebuffer(iRect{x, y, pixelSize, pixelSize}, colors[i]);
+    }
+    return;
+  }
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  if(_hasBufferFunctions){
+    _glBindBuffer(GL_ARRAY_BUFFER, _positionBuffer);
+    glVertexPointer(2, GL_FLOAT, 0, nullptr);
+    _glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  else
+    glVertexPointer(2, GL_FLOAT, 0, _positionStaging.data());
+  glColorPointer(4, GL_UNSIGNED_BYTE, 0, colors);
   glPointSize(pixelSize);
   glDrawArrays(GL_POINTS, first, count);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Returns the memory to write the next frame of screen colors to; the colors are uploaded and
+// drawn by a following call to drawScreenTexture. Colors are expected row by row with the 
+// bottom row first.
+//
+// note: the memory does not retain the colors of previous frames; only the regions passed to
+// drawScreenTexture need be written. If the texture is not valid (isScreenTextureValid) all
+// colors must be written and uploaded.
+Color4* Renderer::mapScreenTexture(int width, int height)
+{
+  assert(_renderMode == RENDER_TEXTURE);
+  assert(!_isScreenBufferMapped);
+
+  // the staging memory is the texture, so retains the colors of previous frames.
+  if(isSoftware()){
+    if(_screenTextureSize._x != width || _screenTextureSize._y != height){
+      _screenStaging.resize(width * height);
+      _screenTextureSize = Vector2i{width, height};
+      _isScreenTextureValid = false;
+    }
+    return _screenStaging.data();
+  }
+
+  if(_screenTextureSize._x != width || _screenTextureSize._y != height)
+    createScreenTexture(width, height);
+
+  // alternate buffers so the driver can still be uploading from last frame's buffer while this
+  // frame's colors are written; respecifying the buffer's storage (orphaning) before mapping 
+  // avoids waiting on any pending use of it.
+  _screenBufferNo = (_screenBufferNo + 1) % numScreenBuffers;
+  _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _screenBuffers[_screenBufferNo]);
+  _glBufferData(GL_PIXEL_UNPACK_BUFFER, width * height * sizeof(Color4), nullptr, GL_STREAM_DRAW);
+  void* colors = _glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  _isScreenBufferMapped = (colors != nullptr);
+  return _isScreenBufferMapped ? static_cast<Color4*>(colors) : _screenStaging.data();
+}
+
+// Uploads the regions (in screen pixels) of the colors written to the memory returned by 
+// mapScreenTexture to the screen texture, then draws the texture over the destination rectangle
+// (in window coordinates). Regions not uploaded keep their colors from previous frames.
+void Renderer::drawScreenTexture(iRect destination, const iRect* regions, int numRegions)
+{
+  assert(_renderMode == RENDER_TEXTURE);
+
+  if(isSoftware()){
+    _isScreenTextureValid = true;
+    drawFramebufferTexture(destination);
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, _screenTexture);
+
+  // with a bound PBO the 'pixels' argument of glTexSubImage2D is an offset into the PBO.
+  const uint8_t* source = reinterpret_cast<const uint8_t*>(_screenStaging.data());
+  if(_isScreenBufferMapped){
+    _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _screenBuffers[_screenBufferNo]);
+    _glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    source = nullptr;
+  }
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, _screenTextureSize._x);
+  for(int i = 0; i < numRegions; ++i){
+    const iRect& region = regions[i];
+    uintptr_t offset = ((region._y * _screenTextureSize._x) + region._x) * sizeof(Color4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, region._x, region._y, region._w, region._h, GL_RGBA, 
+                    GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(source) + offset));
+  }
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+  if(_isScreenBufferMapped){
+    _glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    _isScreenBufferMapped = false;
+  }
+  _isScreenTextureValid = true;
+
+  float x0 = destination._x;
+  float y0 = destination._y;
+  float x1 = destination._x + destination._w;
+  float y1 = destination._y + destination._h;
+
+  glEnable(GL_TEXTURE_2D);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glBegin(GL_QUADS);
+    glTexCoord2f(0.f, 0.f); glVertex2f(x0, y0);
+    glTexCoord2f(1.f, 0.f); glVertex2f(x1, y0);
+    glTexCoord2f(1.f, 1.f); glVertex2f(x1, y1);
+    glTexCoord2f(0.f, 1.f); glVertex2f(x0, y1);
+  glEnd();
+  glDisable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 void Renderer::show()
 {
+  if(isSoftware())
+    return;
   SDL_GL_SwapWindow(_window);
 }
 
+// Makes the opengl context current (or not) on the calling thread; a context can be current on
+// only one thread at a time and all renderer calls must be made on the thread it is current on.
+void Renderer::makeContextCurrent(bool isCurrent)
+{
+  if(isSoftware())
+    return;
+  if(SDL_GL_MakeCurrent(_window, isCurrent ? _glContext : nullptr) != 0)
+    sk::log->log(Log::ERROR, logstr::fail_make_context_current, SDL_GetError());
+}
+
+// Sets the number of display refreshes show waits for before swapping; 0 swaps immediately, 1 
+// syncs swaps to the display's vertical refresh (vsync).
+int Renderer::setSwapInterval(int interval)
+{
+  if(isSoftware())
+    return -1;
+  return (SDL_GL_SetSwapInterval(interval) == 0) ? 0 : -1;
+}
+
+// Returns the refresh rate (Hz) of the window's display, or 0 if unknown.
+int Renderer::getRefreshRate() const
+{
+  if(isSoftware())
+    return 0;
+  SDL_DisplayMode mode;
+  int displayNo = SDL_GetWindowDisplayIndex(_window);
+  if(displayNo < 0 || SDL_GetCurrentDisplayMode(displayNo, &mode) != 0)
+    return 0;
+  return mode.refresh_rate;
+}
+
 Vector2i Renderer::getWindowSize() const
 {
+  if(isSoftware())
+    return _framebufferSize;
   int w, h;
   SDL_GL_GetDrawableSize(_window, &w, &h);
   return Vector2i{w, h};
 }
 
+// Fills a region (in viewport coordinates) of the software framebuffer, clipped to the viewport.
+void Renderer::fillFramebuffer(iRect region, const Color4& color)
+{
+  region._x += _viewport._x;
+  region._y += _viewport._y;
+  region = region.intersected(_viewport).intersected(iRect{0, 0, _framebufferSize._x, _framebufferSize._y});
+  for(int y = region._y; y < region._y + region._h; ++y)
+    std::fill_n(_framebuffer.data() + region._x + (y * _framebufferSize._x), region._w, color);
+}
+
+// Draws the whole screen texture (the staging colors) scaled over the destination rectangle (in 
+// viewport coordinates) of the software framebuffer using nearest sampling, as the opengl 
+// backend does.
+void Renderer::drawFramebufferTexture(iRect destination)
+{
+  destination._x += _viewport._x;
+  destination._y += _viewport._y;
+  iRect clipped = destination.intersected(_viewport).intersected(iRect{0, 0, _framebufferSize._x, _framebufferSize._y});
+  if(clipped.isEmpty())
+    return;
+
+  std::vector<int> sourceCols(clipped._w);
+  for(int x = 0; x < clipped._w; ++x)
+    sourceCols[x] = ((clipped._x + x - destination._x) * _screenTextureSize._x) / destination._w;
+
+  for(int y = clipped._y; y < clipped._y + clipped._h; ++y){
+    int sourceRow = ((y - destination._y) * _screenTextureSize._y) / destination._h;
+    const Color4* source = _screenStaging.data() + (sourceRow * _screenTextureSize._x);
+    Color4* target = _framebuffer.data() + clipped._x + (y * _framebufferSize._x);
+    for(int x = 0; x < clipped._w; ++x)
+      target[x] = source[sourceCols[x]];
+  }
+}
+
+// Returns a 64-bit FNV-1a hash of the software framebuffer's pixels; identical frames have 
+// identical hashes, so a run's output can be checked without storing the frames.
+uint64_t Renderer::hashFramebuffer() const
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(_framebuffer.data());
+  size_t numBytes = _framebuffer.size() * sizeof(Color4);
+  uint64_t hash {0xcbf29ce484222325};
+  for(size_t i = 0; i < numBytes; ++i){
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// Writes the software framebuffer to a binary (P6) ppm file; alpha is discarded.
+int Renderer::captureFramebuffer(const std::string& filename) const
+{
+  FILE* file = fopen(filename.c_str(), "wb");
+  if(file == nullptr){
+    sk::log->log(Log::ERROR, logstr::fail_capture_framebuffer, filename);
+    return -1;
+  }
+
+  fprintf(file, "P6\n%d %d\n255\n", _framebufferSize._x, _framebufferSize._y);
+
+  // ppm rows are stored top first whereas the framebuffer has the bottom row first.
+  std::vector<uint8_t> row(_framebufferSize._x * 3);
+  for(int y = _framebufferSize._y - 1; y >= 0; --y){
+    const Color4* pixel = _framebuffer.data() + (y * _framebufferSize._x);
+    for(int x = 0; x < _framebufferSize._x; ++x, ++pixel){
+      row[(x * 3) + 0] = pixel->getRed();
+      row[(x * 3) + 1] = pixel->getGreen();
+      row[(x * 3) + 2] = pixel->getBlue();
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+
+  if(fclose(file) != 0){
+    sk::log->log(Log::ERROR, logstr::fail_capture_framebuffer, filename);
+    return -1;
+  }
+  return 0;
+}
+
 std::unique_ptr<Renderer> renderer {nullptr};
 
+// A read-only memory mapping of a whole file. Lets loaders decode directly from the file bytes
+// without any per-read seeks, syscalls or copies into scratch buffers.
+class MappedFile
+{
+public:
+  MappedFile() : _bytes{nullptr}, _size{0}{}
+  ~MappedFile() {close();}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  int open(const std::string& filename);
+  void close();
+  const uint8_t* getBytes() const {return _bytes;}
+  size_t getSize() const {return _size;}
+private:
+  const uint8_t* _bytes;
+  size_t _size;
+};
+
+int MappedFile::open(const std::string& filename)
+{
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if(fd < 0){
+    return -1;
+  }
+
+  struct stat status;
+  if(fstat(fd, &status) < 0 || status.st_size <= 0){
+    ::close(fd);
+    return -1;
+  }
+
+  void* bytes = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);                                  // the mapping keeps its own reference.
+  if(bytes == MAP_FAILED){
+    return -1;
+  }
+
+  madvise(bytes, status.st_size, MADV_SEQUENTIAL);
+
+  _bytes = static_cast<const uint8_t*>(bytes);
+  _size = static_cast<size_t>(status.st_size);
+  return 0;
+}
+
+void MappedFile::close()
+{
+  if(_bytes != nullptr)
+    munmap(const_cast<uint8_t*>(_bytes), _size);
+  _bytes = nullptr;
+  _size = 0;
+}
+
 static const uint32_t bitmapFileMagic {0x4d42};
 static const uint32_t colorSpaceSRGBMagic {0x73524742};
 
@@ -573,6 +1362,26 @@ int64_t extractLittleEndianInt64(char* buffer)
   return *(reinterpret_cast<int64_t*>(buffer));
 }
 
+// Reads a type T from a read-only byte buffer containing the bytes of T stored in little-endian
+// format. Unlike the extract functions these assemble the value byte by byte so work on any
+// system without modifying the buffer, which is needed for read-only (mapped) memory.
+
+uint16_t readLittleEndianUint16(const uint8_t* bytes)
+{
+  return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t readLittleEndianUint32(const uint8_t* bytes)
+{
+  return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+         (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+int32_t readLittleEndianInt32(const uint8_t* bytes)
+{
+  return static_cast<int32_t>(readLittleEndianUint32(bytes));
+}
+
 // note: I am choosing NOT to pack these structs for use with reading binary data from a stream;
 // struct packing can lead to problems on certain platforms. Read binary data into arrays and
 // extract the data manually.
@@ -685,46 +1494,361 @@ enum BitmapFileCompressionMode
   BI_CMYKRLE8, BI_CMYKRLE4
 };
 
-class Image
+// shifts needed to move each masked color channel down to the LSB of the raw pixel bytes.
+struct ChannelShifts
 {
-public:
-  int loadBmp(std::string filename);
-  const std::vector<Color4>& getPixels() const {return _pixels;}
-  int getWidth() const {return _width_px;}
-  int getHeight() const {return _height_px;}
-private:
-  void extractFileHeader(std::ifstream& file, BitmapFileHeader& header);
-  void extractInfoHeader(std::ifstream& file, BitmapInfoHeader& header);
-  void extractAppendedRGBMasks(std::ifstream& file, BitmapInfoHeader& header);
-  void extractColorPalette(std::ifstream& file, BitmapInfoHeader& header, std::vector<Color4>& palette);
-  void extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
-  void extractPixels(std::ifstream& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
-private:
-  std::vector<Color4> _pixels;
-  int _width_px;
-  int _height_px;
+  int _red;
+  int _green;
+  int _blue;
+  int _alpha;
 };
 
-int Image::loadBmp(std::string filename)
+// Decodes a row of 16-bit, 24-bit or 32-bit pixels into colors. This is the reference (scalar)
+// decoder; the vectorized decoders below must produce bit-identical output.
+void decodeRow(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+               const ChannelShifts& shifts, Color4* pixels)
 {
-  std::ifstream file {filename, std::ios_base::binary};
-  if(!file){
-    return -1;
-  }
+  int pixelSize_bytes = header._bitsPerPixel / 8;
 
-  BitmapFileHeader fileHeader {};
-  extractFileHeader(file, fileHeader);
-  if(fileHeader._fileMagic != bitmapFileMagic){
-    return -1;
-  }
+  // for each pixel.
+  for(int j = 0; j < width; ++j){
+    uint32_t rawPixelBytes {0};
 
-  BitmapInfoHeader infoHeader {};
-  extractInfoHeader(file, infoHeader);
+    // for each pixel byte.
+    for(int k = 0; k < pixelSize_bytes; ++k){
+      uint8_t pixelByte = row[(j * pixelSize_bytes) + k];
 
-  // other compression modes are not supported.
-  if(infoHeader._compression != BI_RGB && infoHeader._compression != BI_BITFIELDS){
-    return -1;
-  }
+      // 0rth byte of pixel stored in LSB of rawPixelBytes.
+      rawPixelBytes |= static_cast<uint32_t>(pixelByte) << (k * 8);
+    }
+
+    uint8_t red = (rawPixelBytes & header._redMask) >> shifts._red;
+    uint8_t green = (rawPixelBytes & header._greenMask) >> shifts._green;
+    uint8_t blue = (rawPixelBytes & header._blueMask) >> shifts._blue;
+    uint8_t alpha = (rawPixelBytes & header._alphaMask) >> shifts._alpha;
+
+    pixels[j] = Color4{red, green, blue, alpha};
+  }
+}
+
+using RowDecoder_t = void (*)(const uint8_t*, int, const BitmapInfoHeader&, const ChannelShifts&, Color4*);
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// VECTORIZED ROW DECODERS
+//
+// Each decoder handles as many pixels as it can in vector registers and leaves the remainder
+// of the row to the scalar decoder. Decoders never read beyond the last pixel byte of the row
+// since rows may end at the end of a mapped file.
+//
+// There are two kinds of decoder:
+//
+//   shuffle decoders - for the common BGR24 and BGRA32 layouts (8-bit channels at byte
+//                      boundaries) each output color is just a byte permutation of the input.
+//
+//   field decoders   - for arbitrary BI_BITFIELDS masks (which includes 565 and 555 16-bit
+//                      pixels); raw pixels are widened to 32-bit lanes and each channel is
+//                      masked and shifted with precomputed mask and shift vectors. This is the
+//                      scalar algorithm applied to 4 (SSE) or 8 (AVX2) pixels at once.
+//
+// note: decoders are compiled with target attributes so the base build flags need not enable
+// any instruction set extensions; they are only called after a runtime cpu check.
+
+static_assert(sizeof(Color4) == 4, "vectorized row decoders write Color4 as packed 32-bit lanes");
+
+#define SK_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SK_TARGET_AVX2 __attribute__((target("avx2")))
+
+// 4 x BGR -> 4 x RGB0, reading 12 of 16 loaded bytes.
+SK_TARGET_SSE41 static inline __m128i shuffleBgr24ToRgba(__m128i bytes)
+{
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  return _mm_shuffle_epi8(bytes, shuffle);
+}
+
+// 4 x BGR -> 4 x raw 32-bit little-endian pixels (high byte zero).
+SK_TARGET_SSE41 static inline __m128i shuffleBgr24ToRaw(__m128i bytes)
+{
+  const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  return _mm_shuffle_epi8(bytes, shuffle);
+}
+
+SK_TARGET_SSE41 void decodeBgr24RowSse41(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                         const ChannelShifts& shifts, Color4* pixels)
+{
+  int j {0};
+  for(; (j * 3) + 16 <= width * 3; j += 4){
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (j * 3)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + j), shuffleBgr24ToRgba(bytes));
+  }
+  decodeRow(row + (j * 3), width - j, header, shifts, pixels + j);
+}
+
+SK_TARGET_SSE41 void decodeBgra32RowSse41(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                          const ChannelShifts& shifts, Color4* pixels)
+{
+  // alpha is either the 4th byte or (with a zero alpha mask) zero.
+  const char a = header._alphaMask ? 3 : -1;
+  const __m128i shuffle = _mm_setr_epi8(2, 1, 0, a, 6, 5, 4, a + 4 * (a >= 0), 10, 9, 8, 
+                                        a + 8 * (a >= 0), 14, 13, 12, a + 12 * (a >= 0));
+  int j {0};
+  for(; j + 4 <= width; j += 4){
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (j * 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + j), _mm_shuffle_epi8(bytes, shuffle));
+  }
+  decodeRow(row + (j * 4), width - j, header, shifts, pixels + j);
+}
+
+SK_TARGET_SSE41 static inline __m128i decodeFieldsSse41(__m128i raw, const __m128i masks[4], 
+                                                        const __m128i counts[4])
+{
+  const __m128i byte = _mm_set1_epi32(0xff);
+  __m128i red = _mm_and_si128(_mm_srl_epi32(_mm_and_si128(raw, masks[0]), counts[0]), byte);
+  __m128i green = _mm_and_si128(_mm_srl_epi32(_mm_and_si128(raw, masks[1]), counts[1]), byte);
+  __m128i blue = _mm_and_si128(_mm_srl_epi32(_mm_and_si128(raw, masks[2]), counts[2]), byte);
+  __m128i alpha = _mm_and_si128(_mm_srl_epi32(_mm_and_si128(raw, masks[3]), counts[3]), byte);
+  return _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)), 
+                      _mm_or_si128(_mm_slli_epi32(blue, 16), _mm_slli_epi32(alpha, 24)));
+}
+
+template<int bitsPerPixel>
+SK_TARGET_SSE41 void decodeFieldsRowSse41(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                          const ChannelShifts& shifts, Color4* pixels)
+{
+  constexpr int pixelSize_bytes {bitsPerPixel / 8};
+  constexpr int loadSize_bytes {(bitsPerPixel == 16) ? 8 : 16};
+
+  const __m128i masks[4] {
+    _mm_set1_epi32(header._redMask), _mm_set1_epi32(header._greenMask),
+    _mm_set1_epi32(header._blueMask), _mm_set1_epi32(header._alphaMask)
+  };
+  const __m128i counts[4] {
+    _mm_cvtsi32_si128(shifts._red), _mm_cvtsi32_si128(shifts._green),
+    _mm_cvtsi32_si128(shifts._blue), _mm_cvtsi32_si128(shifts._alpha)
+  };
+
+  int j {0};
+  for(; (j * pixelSize_bytes) + loadSize_bytes <= width * pixelSize_bytes; j += 4){
+    const uint8_t* src = row + (j * pixelSize_bytes);
+    __m128i raw;
+    if constexpr(bitsPerPixel == 16)
+      raw = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)));
+    else if constexpr(bitsPerPixel == 24)
+      raw = shuffleBgr24ToRaw(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    else
+      raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + j), decodeFieldsSse41(raw, masks, counts));
+  }
+  decodeRow(row + (j * pixelSize_bytes), width - j, header, shifts, pixels + j);
+}
+
+// 8 x BGR (two groups of 4, one per 128-bit lane) loaded from 28 bytes.
+SK_TARGET_AVX2 static inline __m256i loadBgr24x8(const uint8_t* src)
+{
+  __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 12));
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+SK_TARGET_AVX2 void decodeBgr24RowAvx2(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                       const ChannelShifts& shifts, Color4* pixels)
+{
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                           2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+  int j {0};
+  for(; (j * 3) + 28 <= width * 3; j += 8){
+    __m256i bytes = loadBgr24x8(row + (j * 3));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + j), _mm256_shuffle_epi8(bytes, shuffle));
+  }
+  decodeBgr24RowSse41(row + (j * 3), width - j, header, shifts, pixels + j);
+}
+
+SK_TARGET_AVX2 void decodeBgra32RowAvx2(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                        const ChannelShifts& shifts, Color4* pixels)
+{
+  const char a = header._alphaMask ? 3 : -1;
+  const char a4 = a + 4 * (a >= 0), a8 = a + 8 * (a >= 0), a12 = a + 12 * (a >= 0);
+  const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, a, 6, 5, 4, a4, 10, 9, 8, a8, 14, 13, 12, a12,
+                                           2, 1, 0, a, 6, 5, 4, a4, 10, 9, 8, a8, 14, 13, 12, a12);
+  int j {0};
+  for(; j + 8 <= width; j += 8){
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + (j * 4)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + j), _mm256_shuffle_epi8(bytes, shuffle));
+  }
+  decodeBgra32RowSse41(row + (j * 4), width - j, header, shifts, pixels + j);
+}
+
+template<int bitsPerPixel>
+SK_TARGET_AVX2 void decodeFieldsRowAvx2(const uint8_t* row, int width, const BitmapInfoHeader& header, 
+                                        const ChannelShifts& shifts, Color4* pixels)
+{
+  constexpr int pixelSize_bytes {bitsPerPixel / 8};
+  constexpr int loadSize_bytes {(bitsPerPixel == 16) ? 16 : (bitsPerPixel == 24) ? 28 : 32};
+
+  const __m256i byte = _mm256_set1_epi32(0xff);
+  const __m256i redMask = _mm256_set1_epi32(header._redMask);
+  const __m256i greenMask = _mm256_set1_epi32(header._greenMask);
+  const __m256i blueMask = _mm256_set1_epi32(header._blueMask);
+  const __m256i alphaMask = _mm256_set1_epi32(header._alphaMask);
+  const __m128i redCount = _mm_cvtsi32_si128(shifts._red);
+  const __m128i greenCount = _mm_cvtsi32_si128(shifts._green);
+  const __m128i blueCount = _mm_cvtsi32_si128(shifts._blue);
+  const __m128i alphaCount = _mm_cvtsi32_si128(shifts._alpha);
+  const __m256i rawShuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                              0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+  int j {0};
+  for(; (j * pixelSize_bytes) + loadSize_bytes <= width * pixelSize_bytes; j += 8){
+    const uint8_t* src = row + (j * pixelSize_bytes);
+    __m256i raw;
+    if constexpr(bitsPerPixel == 16)
+      raw = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    else if constexpr(bitsPerPixel == 24)
+      raw = _mm256_shuffle_epi8(loadBgr24x8(src), rawShuffle);
+    else
+      raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+
+    __m256i red = _mm256_and_si256(_mm256_srl_epi32(_mm256_and_si256(raw, redMask), redCount), byte);
+    __m256i green = _mm256_and_si256(_mm256_srl_epi32(_mm256_and_si256(raw, greenMask), greenCount), byte);
+    __m256i blue = _mm256_and_si256(_mm256_srl_epi32(_mm256_and_si256(raw, blueMask), blueCount), byte);
+    __m256i alpha = _mm256_and_si256(_mm256_srl_epi32(_mm256_and_si256(raw, alphaMask), alphaCount), byte);
+    __m256i rgba = _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, 8)), 
+                                   _mm256_or_si256(_mm256_slli_epi32(blue, 16), _mm256_slli_epi32(alpha, 24)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + j), rgba);
+  }
+  decodeFieldsRowSse41<bitsPerPixel>(row + (j * pixelSize_bytes), width - j, header, shifts, pixels + j);
+}
+
+#undef SK_TARGET_SSE41
+#undef SK_TARGET_AVX2
+
+#endif
+
+// Selects the fastest row decoder for the pixel format of a 16-bit, 24-bit or 32-bit bitmap on
+// this cpu.
+RowDecoder_t selectRowDecoder(const BitmapInfoHeader& header)
+{
+  SimdLevel level = std::min(detectSimdLevel(), maxSimdLevel);
+  if(level == SIMD_NONE)
+    return &decodeRow;
+
+#if defined(__x86_64__) || defined(__i386__)
+  bool isAvx2 = (level == SIMD_AVX2);
+
+  bool isByteChannels = header._redMask == 0x00ff0000 && header._greenMask == 0x0000ff00 &&
+                        header._blueMask == 0x000000ff;
+
+  switch(header._bitsPerPixel)
+  {
+  case 16:
+    return isAvx2 ? &decodeFieldsRowAvx2<16> : &decodeFieldsRowSse41<16>;
+  case 24:
+    if(isByteChannels && header._alphaMask == 0)
+      return isAvx2 ? &decodeBgr24RowAvx2 : &decodeBgr24RowSse41;
+    return isAvx2 ? &decodeFieldsRowAvx2<24> : &decodeFieldsRowSse41<24>;
+  case 32:
+    if(isByteChannels && (header._alphaMask == 0 || header._alphaMask == 0xff000000))
+      return isAvx2 ? &decodeBgra32RowAvx2 : &decodeBgra32RowSse41;
+    return isAvx2 ? &decodeFieldsRowAvx2<32> : &decodeFieldsRowSse41<32>;
+  }
+#endif
+
+  return &decodeRow;
+}
+
+// For each possible byte of a paletted pixel row, the palette indices of the pixels packed in
+// the byte, left-most pixel first. One table per supported index size (1, 2, 4 and 8 bits); 
+// only the first (8 / bitsPerPixel) indices of each entry are used.
+struct PaletteIndexTable
+{
+  uint8_t _indices[256][8];
+};
+
+constexpr PaletteIndexTable makePaletteIndexTable(int bitsPerPixel)
+{
+  PaletteIndexTable table {};
+  int numPixelsPerByte = 8 / bitsPerPixel;
+  int mask = (1 << bitsPerPixel) - 1;
+  for(int byte = 0; byte < 256; ++byte){
+    for(int i = 0; i < numPixelsPerByte; ++i){
+      int shift = bitsPerPixel * (numPixelsPerByte - 1 - i);
+      table._indices[byte][i] = static_cast<uint8_t>((byte >> shift) & mask);
+    }
+  }
+  return table;
+}
+
+constexpr std::array<PaletteIndexTable, 4> paletteIndexTables {
+  makePaletteIndexTable(1), makePaletteIndexTable(2), makePaletteIndexTable(4), makePaletteIndexTable(8)
+};
+
+constexpr int calculatePaletteIndexTableNo(int bitsPerPixel)
+{
+  return (bitsPerPixel == 1) ? 0 : (bitsPerPixel == 2) ? 1 : (bitsPerPixel == 4) ? 2 : 3;
+}
+
+// Expands each byte of a paletted row to its run of colors. The run length is a template 
+// parameter so each copy is a fixed size move the compiler can inline.
+template<int numPixelsPerByte>
+void expandPalettedBytes(const uint8_t* row, int numBytes, const Color4* byteColors, Color4* pixels)
+{
+  for(int byteNo = 0; byteNo < numBytes; ++byteNo, pixels += numPixelsPerByte)
+    memcpy(pixels, byteColors + (row[byteNo] * numPixelsPerByte), numPixelsPerByte * sizeof(Color4));
+}
+
+class Image
+{
+public:
+  int loadBmp(std::string filename);
+  int loadBmpMapped(std::string filename);
+  const std::vector<Color4>& getPixels() const {return _pixels;}
+  int getWidth() const {return _width_px;}
+  int getHeight() const {return _height_px;}
+private:
+  static constexpr int maxPaletteSize {256};
+  static constexpr int maxDimension_px {1 << 15};
+private:
+  void extractFileHeader(std::ifstream& file, BitmapFileHeader& header);
+  void extractInfoHeader(std::ifstream& file, BitmapInfoHeader& header);
+  void extractAppendedRGBMasks(std::ifstream& file, BitmapInfoHeader& header);
+  void extractColorPalette(std::ifstream& file, BitmapInfoHeader& header, std::vector<Color4>& palette);
+  void extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
+  void extractPixels(std::ifstream& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
+  int extractHeaders(const MappedFile& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
+  int extractColorPalette(const MappedFile& file, BitmapInfoHeader& header, std::vector<Color4>& palette);
+  int extractPalettedPixels(const MappedFile& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
+  void extractPixels(const MappedFile& file, BitmapFileHeader& fileHeader, BitmapInfoHeader& infoHeader);
+  static int calculateRowSize(const BitmapInfoHeader& header);
+  static int calculatePaletteSize(const BitmapInfoHeader& header);
+  static ChannelShifts calculateChannelShifts(const BitmapInfoHeader& header);
+  static void buildByteColorTable(int bitsPerPixel, const std::vector<Color4>& palette, std::vector<Color4>& byteColors);
+  static void decodePalettedRow(const uint8_t* row, int width, int bitsPerPixel, const Color4* byteColors, Color4* pixels);
+private:
+  std::vector<Color4> _pixels;
+  int _width_px;
+  int _height_px;
+};
+
+int Image::loadBmp(std::string filename)
+{
+  std::ifstream file {filename, std::ios_base::binary};
+  if(!file){
+    return -1;
+  }
+
+  BitmapFileHeader fileHeader {};
+  extractFileHeader(file, fileHeader);
+  if(fileHeader._fileMagic != bitmapFileMagic){
+    return -1;
+  }
+
+  BitmapInfoHeader infoHeader {};
+  extractInfoHeader(file, infoHeader);
+
+  // other compression modes are not supported.
+  if(infoHeader._compression != BI_RGB && infoHeader._compression != BI_BITFIELDS){
+    return -1;
+  }
 
   bool V2 {false}, V3_4_5 {false};
   switch(infoHeader._headerSize_bytes)
@@ -754,7 +1878,8 @@ int Image::loadBmp(std::string filename)
     // fallthrough
     
   case BitmapInfoHeader::BITMAPINFOHEADER_SIZE_BYTES:
-    if(infoHeader._bitsPerPixel <= 8){
+    if(infoHeader._bitsPerPixel == 1 || infoHeader._bitsPerPixel == 2 || 
+       infoHeader._bitsPerPixel == 4 || infoHeader._bitsPerPixel == 8){
       extractPalettedPixels(file, fileHeader, infoHeader);
     }
     else if(infoHeader._bitsPerPixel == 16){
@@ -905,8 +2030,9 @@ void Image::extractColorPalette(std::ifstream& file, BitmapInfoHeader& header,
                                 std::vector<Color4>& palette)
 {
   char bytes[4];
+  int numColors = calculatePaletteSize(header);
   file.seekg(BitmapFileHeader::size_bytes + header._headerSize_bytes);
-  for(uint8_t i = 0; i < header._numPaletteColors; ++i){
+  for(int i = 0; i < numColors; ++i){
     file.read(bytes, 4);
 
     // colors expected in the byte order blue (0), green (1), red (2), alpha (3).
@@ -917,6 +2043,9 @@ void Image::extractColorPalette(std::ifstream& file, BitmapInfoHeader& header,
 
     palette.push_back(Color4{red, green, blue, alpha});
   }
+
+  // pad the palette so any index a row can hold is valid, even in malformed files.
+  palette.resize(maxPaletteSize);
 }
 
 void Image::extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHeader, 
@@ -924,58 +2053,13 @@ void Image::extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHea
 {
   // note: this function handles 1-bit, 2-bit, 4-bit and 8-bit pixels.
 
-  // FORMAT OF INDICES IN A BYTE
-  //
-  // For pixels of 8-bits or less, the pixel data consists of indices into a color palette. The
-  // indices are either 1-bit, 2-bit, 4-bit or 8-bit values and are packed into the bytes of a
-  // row such that, for example, a bitmap with 2-bit indices, will have 4 indices in each byte
-  // of a row.
-  //
-  // Consider an 8x1 [width, height] bitmap with 2-bit indices permitting 2^2=4 colors in the
-  // palette illustrated as:
-  //
-  //            p0 p1 p2 p3 p4 p5 p6 p7        pN == pixel number in the row
-  //           +--+--+--+--+--+--+--+--+
-  //           |I0|I1|I0|I2|I0|I3|I0|I1|       IN == index N into color palette
-  //           +--+--+--+--+--+--+--+--+
-  //                [8x1 bitmap]
-  //
-  // Since this bitmap uses 2-bits per index, 4 indices (so 4 pixels) can be packed into a 
-  // single byte. The specific format for how these indices are packed is such that the 
-  // left-most pixel in the row is stored in the most-significant bits of the byte which can 
-  // be illustrated as:
-  //
-  //                 p0 p1 p2 p3
-  //              0b 00 01 00 10     <-- the 0rth byte in the bottom row (the only row).
-  //                 ^  ^  ^  ^
-  //                 |  |  |  |
-  //                 I0 I1 I0 I2
-  //
-  // The bottom row will actually consist of 4 bytes in total. We will have 2 bytes for the 
-  // pixels since the row has 8 pixels and we can pack 4 indices (1 for each pixel) into a 
-  // single byte, and we will have 2 bytes of padding since rows must be 4-byte aligned in the
-  // bitmap file. Thus our full row bytes will read as:
-  //
-  //                [byte0]          [byte1]         [byte2]          [byte3]
-  //               p0 p1 p2 p3      p4 p5 p6 p7
-  //          | 0b 00 01 00 10 | 0b 00 11 00 01 { 0b 00 00 00 00 | 0b 00 00 00 00 }
-  //               ^  ^  ^  ^       ^  ^  ^  ^
-  //               |  |  |  |       |  |  |  |               [padding]
-  //               I0 I1 I0 I2      I0 I3 I0 I1
-  //              
-  // note that although the pixels are stored from left-to-right, the bits in the indices are
-  // still read from right-to-left, i.e. decimal 2 = 0b10 and not 0b01.
-
   std::vector<Color4> palette {};
   extractColorPalette(file, infoHeader, palette);
 
-  int rowSize_bytes = std::ceil((infoHeader._bitsPerPixel * infoHeader._bmpWidth_px) / 32.f) * 4.f;  
-  int numPixelsPerByte = 8 / infoHeader._bitsPerPixel;
-
-  uint8_t mask {0};
-  for(int i = 0; i < infoHeader._bitsPerPixel; ++i)
-    mask |= (0x01 << i);
+  std::vector<Color4> byteColors {};
+  buildByteColorTable(infoHeader._bitsPerPixel, palette, byteColors);
 
+  int rowSize_bytes = calculateRowSize(infoHeader);
   int numRows = std::abs(infoHeader._bmpHeight_px);
   bool isTopOrigin = (infoHeader._bmpHeight_px < 0);
   int pixelOffset_bytes = static_cast<int>(fileHeader._pixelOffset_bytes);
@@ -985,7 +2069,7 @@ void Image::extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHea
     rowOffset_bytes *= -1;
   }
 
-  _pixels.reserve(infoHeader._bmpWidth_px * numRows);
+  _pixels.resize(infoHeader._bmpWidth_px * numRows);
 
   int seekPos {pixelOffset_bytes};
   char* row = new char[rowSize_bytes];
@@ -994,23 +2078,9 @@ void Image::extractPalettedPixels(std::ifstream& file, BitmapFileHeader& fileHea
   for(int i = 0; i < numRows; ++i){
     file.seekg(seekPos);
     file.read(static_cast<char*>(row), rowSize_bytes);
-
-    // for each pixel in the row.
-    int numPixelsExtracted {0};
-    int byteNo {0};
-    int bytePixelNo {0};
-    uint8_t byte = static_cast<uint8_t>(row[byteNo]);
-    while(numPixelsExtracted < infoHeader._bmpWidth_px){
-      if(bytePixelNo >= numPixelsPerByte){
-        byte = static_cast<uint8_t>(row[++byteNo]);
-        bytePixelNo = 0;
-      }
-      int shift = infoHeader._bitsPerPixel * (numPixelsPerByte - 1 - bytePixelNo);
-      uint8_t index = (byte & (mask << shift)) >> shift;
-      _pixels.push_back(palette[index]);
-      ++numPixelsExtracted;
-      ++bytePixelNo;
-    }
+    decodePalettedRow(reinterpret_cast<const uint8_t*>(row), infoHeader._bmpWidth_px, 
+                      infoHeader._bitsPerPixel, byteColors.data(), 
+                      _pixels.data() + (i * infoHeader._bmpWidth_px));
     seekPos += rowOffset_bytes;
   }
   delete[] row;
@@ -1027,9 +2097,7 @@ void Image::extractPixels(std::ifstream& file, BitmapFileHeader& fileHeader,
   // in-memory pixels. If the bitmap height is positive then we can simply read the first row
   // in the file first, as this will be the first row in the in-memory bitmap.
   
-  int rowSize_bytes = std::ceil((infoHeader._bitsPerPixel * infoHeader._bmpWidth_px) / 32.f) * 4.f;  
-  int pixelSize_bytes = infoHeader._bitsPerPixel / 8;
-
+  int rowSize_bytes = calculateRowSize(infoHeader);
   int numRows = std::abs(infoHeader._bmpHeight_px);
   bool isTopOrigin = (infoHeader._bmpHeight_px < 0);
   int pixelOffset_bytes = static_cast<int>(fileHeader._pixelOffset_bytes);
@@ -1039,20 +2107,10 @@ void Image::extractPixels(std::ifstream& file, BitmapFileHeader& fileHeader,
     rowOffset_bytes *= -1;
   }
 
-  // shift values are needed when using channel masks to extract color channel data from
-  // the raw pixel bytes.
-  int redShift {0};
-  int greenShift {0};
-  int blueShift {0};
-  int alphaShift {0};
-
-  while((infoHeader._redMask & (0x01 << redShift)) == 0) ++redShift;
-  while((infoHeader._greenMask & (0x01 << greenShift)) == 0) ++greenShift;
-  while((infoHeader._blueMask & (0x01 << blueShift)) == 0) ++blueShift;
-  if(infoHeader._alphaMask)
-    while((infoHeader._alphaMask & (0x01 << alphaShift)) == 0) ++alphaShift;
+  ChannelShifts shifts = calculateChannelShifts(infoHeader);
+  RowDecoder_t decode = selectRowDecoder(infoHeader);
 
-  _pixels.reserve(infoHeader._bmpWidth_px * numRows);
+  _pixels.resize(infoHeader._bmpWidth_px * numRows);
 
   int seekPos {pixelOffset_bytes};
   char* row = new char[rowSize_bytes];
@@ -1061,538 +2119,3953 @@ void Image::extractPixels(std::ifstream& file, BitmapFileHeader& fileHeader,
   for(int i = 0; i < numRows; ++i){
     file.seekg(seekPos);
     file.read(static_cast<char*>(row), rowSize_bytes);
+    decode(reinterpret_cast<const uint8_t*>(row), infoHeader._bmpWidth_px, infoHeader, 
+           shifts, _pixels.data() + (i * infoHeader._bmpWidth_px));
+    seekPos += rowOffset_bytes;
+  }
+  delete[] row;
+}
 
-    // for each pixel.
-    for(int j = 0; j < infoHeader._bmpWidth_px; ++j){
-      uint32_t rawPixelBytes {0};
+// Loads a bmp by mapping the whole file into memory and decoding each row directly from the 
+// mapped bytes. Supports the same formats as loadBmp but all header fields are validated 
+// against the size of the mapping before any pixel data is touched, so truncated or malformed
+// files are rejected rather than read out of bounds.
+int Image::loadBmpMapped(std::string filename)
+{
+  MappedFile file {};
+  if(file.open(filename) != 0){
+    return -1;
+  }
 
-      // for each pixel byte.
-      for(int k = 0; k < pixelSize_bytes; ++k){
-        uint8_t pixelByte = row[(j * pixelSize_bytes) + k];
+  BitmapFileHeader fileHeader {};
+  BitmapInfoHeader infoHeader {};
+  if(extractHeaders(file, fileHeader, infoHeader) != 0){
+    return -1;
+  }
 
-        // 0rth byte of pixel stored in LSB of rawPixelBytes.
-        rawPixelBytes |= static_cast<uint32_t>(pixelByte << (k * 8));
-      }
+  bool V3_4_5 = (infoHeader._headerSize_bytes >= BitmapInfoHeader::BITMAPV3INFOHEADER_SIZE_BYTES);
+  bool isPaletted {false};
+  switch(infoHeader._bitsPerPixel)
+  {
+  case 1:
+  case 2:
+  case 4:
+  case 8:
+    isPaletted = true;
+    break;
+  case 16:
+    if(infoHeader._compression == BI_RGB){
+      infoHeader._redMask   = 0b00000000000000000111110000000000;
+      infoHeader._greenMask = 0b00000000000000000000001111100000;
+      infoHeader._blueMask  = 0b00000000000000000000000000011111;
+      if(!V3_4_5)
+        infoHeader._alphaMask = 0b00000000000000001000000000000000;
+    }
+    break;
+  case 24:
+    infoHeader._redMask   = 0b00000000111111110000000000000000;
+    infoHeader._greenMask = 0b00000000000000001111111100000000;
+    infoHeader._blueMask  = 0b00000000000000000000000011111111;
+    infoHeader._alphaMask = 0b00000000000000000000000000000000;
+    break;
+  case 32:
+    if(infoHeader._compression == BI_RGB){
+      infoHeader._redMask   = 0b00000000111111110000000000000000;
+      infoHeader._greenMask = 0b00000000000000001111111100000000;
+      infoHeader._blueMask  = 0b00000000000000000000000011111111;
+      if(!V3_4_5)
+        infoHeader._alphaMask = 0b11111111000000000000000000000000;
+    }
+    break;
+  default:
+    return -1;
+  }
 
-      uint8_t red = (rawPixelBytes & infoHeader._redMask) >> redShift;
-      uint8_t green = (rawPixelBytes & infoHeader._greenMask) >> greenShift;
-      uint8_t blue = (rawPixelBytes & infoHeader._blueMask) >> blueShift;
-      uint8_t alpha = (rawPixelBytes & infoHeader._alphaMask) >> alphaShift;
+  // zero masks would leave the channel shift calculation searching forever.
+  if(!isPaletted && (!infoHeader._redMask || !infoHeader._greenMask || !infoHeader._blueMask)){
+    return -1;
+  }
 
-      _pixels.push_back(Color4{red, green, blue, alpha});
-    }
-    seekPos += rowOffset_bytes;
+  uint64_t rowSize_bytes = calculateRowSize(infoHeader);
+  uint64_t numRows = std::abs(infoHeader._bmpHeight_px);
+  if(fileHeader._pixelOffset_bytes + (rowSize_bytes * numRows) > file.getSize()){
+    return -1;
   }
-  delete[] row;
-}
 
+  if(isPaletted){
+    if(extractPalettedPixels(file, fileHeader, infoHeader) != 0)
+      return -1;
+  }
+  else
+    extractPixels(file, fileHeader, infoHeader);
 
-// A sprite represents a color image that can be drawn on a virtual screen. Pixels on the sprite
-// are positioned on a coordinate space mapped as shown below.
-//
-//         row
-//          ^
-//          |
-//          |
-//   origin o----> col
-//
-class Sprite
+  _width_px = infoHeader._bmpWidth_px;
+  _height_px = static_cast<int>(numRows);
+
+  return 0;
+}
+
+int Image::extractHeaders(const MappedFile& file, BitmapFileHeader& fileHeader, 
+                          BitmapInfoHeader& infoHeader)
 {
-public:
-  Sprite();
-  Sprite(std::vector<Color4> pixels, int width, int height);
-  ~Sprite() = default;
-  Sprite(const Sprite&) = default;
-  Sprite(Sprite&&) = default;
-  Sprite& operator=(const Sprite&) = default;
-  Sprite& operator=(Sprite&&) = default;
-  void setPixel(int row, int col, const Color4& color);
-  const std::vector<Color4>& getPixels() const {return _pixels;}
-  int getWidth() const {return _width;}
-  int getHeight() const {return _height;}
-private:
-  std::vector<Color4> _pixels;
-  int _width;
-  int _height;
-};
+  const uint8_t* bytes = file.getBytes();
+  size_t size = file.getSize();
 
-Sprite::Sprite() :
-  _pixels{},
-  _width{0},
-  _height{0}
-{}
+  if(size < BitmapFileHeader::size_bytes + BitmapInfoHeader::BITMAPINFOHEADER_SIZE_BYTES){
+    return -1;
+  }
 
-Sprite::Sprite(std::vector<Color4> pixels, int width, int height) : 
-  _width{width},
-  _height{height},
-  _pixels{pixels}
-{}
+  fileHeader._fileMagic = readLittleEndianUint16(bytes);
+  fileHeader._fileSize = readLittleEndianUint32(bytes + 2);
+  fileHeader._pixelOffset_bytes = readLittleEndianUint32(bytes + 10);
+  if(fileHeader._fileMagic != bitmapFileMagic){
+    return -1;
+  }
 
-void Sprite::setPixel(int row, int col, const Color4& color)
-{
-  _pixels[col + (row * _width)] = color;
-}
+  memset(&infoHeader, 0, sizeof(BitmapInfoHeader));
 
-// A virtual screen with fixed resolution independent of display resolution and window size. The
-// screen is positioned centrally in the window with the ratio of virtual pixel size to real
-// pixel size being calculated to fit the window dimensions.
-//
-// Pixels on the screen are arranged on a coordinate system with the origin in the bottom left
+  const uint8_t* info = bytes + BitmapFileHeader::size_bytes;
+  infoHeader._headerSize_bytes = readLittleEndianUint32(info + BIHO_HEADER_SIZE);
+  switch(infoHeader._headerSize_bytes)
+  {
+  case BitmapInfoHeader::BITMAPV5HEADER_SIZE_BYTES:
+  case BitmapInfoHeader::BITMAPV4HEADER_SIZE_BYTES:
+  case BitmapInfoHeader::BITMAPV3INFOHEADER_SIZE_BYTES:
+  case BitmapInfoHeader::BITMAPV2INFOHEADER_SIZE_BYTES:
+  case BitmapInfoHeader::BITMAPINFOHEADER_SIZE_BYTES:
+    break;
+  default:
+    return -1;
+  }
+  if(size < BitmapFileHeader::size_bytes + infoHeader._headerSize_bytes){
+    return -1;
+  }
+
+  infoHeader._bmpWidth_px = readLittleEndianInt32(info + BIHO_BMP_WIDTH);
+  infoHeader._bmpHeight_px = readLittleEndianInt32(info + BIHO_BMP_HEIGHT);
+  infoHeader._numColorPlanes = readLittleEndianUint16(info + BIHO_NUM_COLOR_PLANES);
+  infoHeader._bitsPerPixel = readLittleEndianUint16(info + BIHO_BITS_PER_PIXEL);
+  infoHeader._compression = readLittleEndianUint32(info + BIHO_COMPRESSION);
+  infoHeader._rawImageSize_bytes = readLittleEndianUint32(info + BIHO_RAW_IMAGE_SIZE);
+  infoHeader._horizontalResolution_pxPm = readLittleEndianInt32(info + BIHO_HORIZONTAL_RESOLUTION);
+  infoHeader._verticalResolution_pxPm = readLittleEndianInt32(info + BIHO_VERTICAL_RESOLUTION);
+  infoHeader._numPaletteColors = readLittleEndianUint32(info + BIHO_NUM_PALETTE_COLORS);
+  infoHeader._numImportantColors = readLittleEndianUint32(info + BIHO_NUM_IMPORTANT_COLORS);
+
+  // other compression modes are not supported.
+  if(infoHeader._compression != BI_RGB && infoHeader._compression != BI_BITFIELDS){
+    return -1;
+  }
+
+  // with BI_BITFIELDS and BITMAPINFOHEADER the masks are appended to the info header in the
+  // same file position as the V2 header masks.
+  bool hasMasks = (infoHeader._headerSize_bytes >= BitmapInfoHeader::BITMAPV2INFOHEADER_SIZE_BYTES);
+  if(!hasMasks && infoHeader._compression == BI_BITFIELDS){
+    if(size < BitmapFileHeader::size_bytes + BIHO_ALPHA_MASK){
+      return -1;
+    }
+    hasMasks = true;
+  }
+  if(hasMasks){
+    infoHeader._redMask = readLittleEndianUint32(info + BIHO_RED_MASK);
+    infoHeader._greenMask = readLittleEndianUint32(info + BIHO_GREEN_MASK);
+    infoHeader._blueMask = readLittleEndianUint32(info + BIHO_BLUE_MASK);
+  }
+  if(infoHeader._headerSize_bytes >= BitmapInfoHeader::BITMAPV3INFOHEADER_SIZE_BYTES){
+    infoHeader._alphaMask = readLittleEndianUint32(info + BIHO_ALPHA_MASK);
+  }
+  if(infoHeader._headerSize_bytes >= BitmapInfoHeader::BITMAPV4HEADER_SIZE_BYTES){
+    infoHeader._colorSpaceMagic = readLittleEndianUint32(info + BIHO_COLOR_SPACE_MAGIC);
+
+    // other color spaces not supported.
+    if(infoHeader._colorSpaceMagic != colorSpaceSRGBMagic){
+      return -1;
+    }
+  }
+
+  if(infoHeader._bmpWidth_px <= 0 || infoHeader._bmpHeight_px == 0){
+    return -1;
+  }
+
+  // limits the pixel count so (width * height) cannot overflow an int.
+  if(infoHeader._bmpWidth_px > maxDimension_px || std::abs(infoHeader._bmpHeight_px) > maxDimension_px){
+    return -1;
+  }
+
+  return 0;
+}
+
+int Image::extractColorPalette(const MappedFile& file, BitmapInfoHeader& header, 
+                               std::vector<Color4>& palette)
+{
+  int numColors = calculatePaletteSize(header);
+  size_t paletteOffset_bytes = BitmapFileHeader::size_bytes + header._headerSize_bytes;
+  if(paletteOffset_bytes + (numColors * 4) > file.getSize()){
+    return -1;
+  }
+
+  // colors expected in the byte order blue (0), green (1), red (2), alpha (3).
+  const uint8_t* bytes = file.getBytes() + paletteOffset_bytes;
+  palette.resize(maxPaletteSize);
+  for(int i = 0; i < numColors; ++i, bytes += 4)
+    palette[i] = Color4{bytes[2], bytes[1], bytes[0], bytes[3]};
+
+  return 0;
+}
+
+int Image::extractPalettedPixels(const MappedFile& file, BitmapFileHeader& fileHeader, 
+                                 BitmapInfoHeader& infoHeader)
+{
+  std::vector<Color4> palette {};
+  if(extractColorPalette(file, infoHeader, palette) != 0){
+    return -1;
+  }
+
+  std::vector<Color4> byteColors {};
+  buildByteColorTable(infoHeader._bitsPerPixel, palette, byteColors);
+
+  int width = infoHeader._bmpWidth_px;
+  int numRows = std::abs(infoHeader._bmpHeight_px);
+  ptrdiff_t rowSize_bytes = calculateRowSize(infoHeader);
+  const uint8_t* row = file.getBytes() + fileHeader._pixelOffset_bytes;
+  if(infoHeader._bmpHeight_px < 0){
+    row += (numRows - 1) * rowSize_bytes;
+    rowSize_bytes *= -1;
+  }
+
+  _pixels.resize(width * numRows);
+
+  for(int i = 0; i < numRows; ++i, row += rowSize_bytes)
+    decodePalettedRow(row, width, infoHeader._bitsPerPixel, byteColors.data(), _pixels.data() + (i * width));
+
+  return 0;
+}
+
+void Image::extractPixels(const MappedFile& file, BitmapFileHeader& fileHeader, 
+                          BitmapInfoHeader& infoHeader)
+{
+  int width = infoHeader._bmpWidth_px;
+  int numRows = std::abs(infoHeader._bmpHeight_px);
+  ptrdiff_t rowSize_bytes = calculateRowSize(infoHeader);
+  const uint8_t* row = file.getBytes() + fileHeader._pixelOffset_bytes;
+  if(infoHeader._bmpHeight_px < 0){
+    row += (numRows - 1) * rowSize_bytes;
+    rowSize_bytes *= -1;
+  }
+
+  ChannelShifts shifts = calculateChannelShifts(infoHeader);
+  RowDecoder_t decode = selectRowDecoder(infoHeader);
+
+  _pixels.resize(width * numRows);
+
+  for(int i = 0; i < numRows; ++i, row += rowSize_bytes)
+    decode(row, width, infoHeader, shifts, _pixels.data() + (i * width));
+}
+
+int Image::calculateRowSize(const BitmapInfoHeader& header)
+{
+  // rows are padded to a multiple of 4 bytes in the file.
+  return ((header._bitsPerPixel * header._bmpWidth_px + 31) / 32) * 4;
+}
+
+int Image::calculatePaletteSize(const BitmapInfoHeader& header)
+{
+  // a palette size of 0 in the header means the palette has the max colors for the bit depth.
+  int numColors = header._numPaletteColors;
+  if(numColors == 0 || numColors > (1 << header._bitsPerPixel))
+    numColors = 1 << header._bitsPerPixel;
+  return numColors;
+}
+
+ChannelShifts Image::calculateChannelShifts(const BitmapInfoHeader& header)
+{
+  // shift values are needed when using channel masks to extract color channel data from
+  // the raw pixel bytes.
+  ChannelShifts shifts {0, 0, 0, 0};
+  while((header._redMask & (0x01 << shifts._red)) == 0) ++shifts._red;
+  while((header._greenMask & (0x01 << shifts._green)) == 0) ++shifts._green;
+  while((header._blueMask & (0x01 << shifts._blue)) == 0) ++shifts._blue;
+  if(header._alphaMask)
+    while((header._alphaMask & (0x01 << shifts._alpha)) == 0) ++shifts._alpha;
+  return shifts;
+}
+
+void Image::decodePalettedRow(const uint8_t* row, int width, int bitsPerPixel, 
+                              const Color4* byteColors, Color4* pixels)
+{
+  // FORMAT OF INDICES IN A BYTE
+  //
+  // For pixels of 8-bits or less, the pixel data consists of indices into a color palette. The
+  // indices are either 1-bit, 2-bit, 4-bit or 8-bit values and are packed into the bytes of a
+  // row such that, for example, a bitmap with 2-bit indices, will have 4 indices in each byte
+  // of a row.
+  //
+  // Consider an 8x1 [width, height] bitmap with 2-bit indices permitting 2^2=4 colors in the
+  // palette illustrated as:
+  //
+  //            p0 p1 p2 p3 p4 p5 p6 p7        pN == pixel number in the row
+  //           +--+--+--+--+--+--+--+--+
+  //           |I0|I1|I0|I2|I0|I3|I0|I1|       IN == index N into color palette
+  //           +--+--+--+--+--+--+--+--+
+  //                [8x1 bitmap]
+  //
+  // Since this bitmap uses 2-bits per index, 4 indices (so 4 pixels) can be packed into a 
+  // single byte. The specific format for how these indices are packed is such that the 
+  // left-most pixel in the row is stored in the most-significant bits of the byte which can 
+  // be illustrated as:
+  //
+  //                 p0 p1 p2 p3
+  //              0b 00 01 00 10     <-- the 0rth byte in the bottom row (the only row).
+  //                 ^  ^  ^  ^
+  //                 |  |  |  |
+  //                 I0 I1 I0 I2
+  //
+  // The bottom row will actually consist of 4 bytes in total. We will have 2 bytes for the 
+  // pixels since the row has 8 pixels and we can pack 4 indices (1 for each pixel) into a 
+  // single byte, and we will have 2 bytes of padding since rows must be 4-byte aligned in the
+  // bitmap file. Thus our full row bytes will read as:
+  //
+  //                [byte0]          [byte1]         [byte2]          [byte3]
+  //               p0 p1 p2 p3      p4 p5 p6 p7
+  //          | 0b 00 01 00 10 | 0b 00 11 00 01 { 0b 00 00 00 00 | 0b 00 00 00 00 }
+  //               ^  ^  ^  ^       ^  ^  ^  ^
+  //               |  |  |  |       |  |  |  |               [padding]
+  //               I0 I1 I0 I2      I0 I3 I0 I1
+  //              
+  // note that although the pixels are stored from left-to-right, the bits in the indices are
+  // still read from right-to-left, i.e. decimal 2 = 0b10 and not 0b01.
+  //
+  // Rather than unpack each index with shifts and masks, rows are decoded a byte at a time with
+  // a table holding, for every possible byte value, the run of colors the byte expands to, see
+  // buildByteColorTable. Each byte of the row is thus a single copy of 1, 2, 4 or 8 colors.
+  //
+  // predicate: byteColors was built by buildByteColorTable for bitsPerPixel.
+
+  int numPixelsPerByte = 8 / bitsPerPixel;
+  int numWholeBytes = width / numPixelsPerByte;
+  int numTailPixels = width % numPixelsPerByte;
+
+  switch(numPixelsPerByte)
+  {
+  case 8: expandPalettedBytes<8>(row, numWholeBytes, byteColors, pixels); break;
+  case 4: expandPalettedBytes<4>(row, numWholeBytes, byteColors, pixels); break;
+  case 2: expandPalettedBytes<2>(row, numWholeBytes, byteColors, pixels); break;
+  case 1: expandPalettedBytes<1>(row, numWholeBytes, byteColors, pixels); break;
+  }
+  pixels += numWholeBytes * numPixelsPerByte;
+
+  // the last byte may hold fewer pixels than it has room for.
+  if(numTailPixels)
+    memcpy(pixels, byteColors + (row[numWholeBytes] * numPixelsPerByte), numTailPixels * sizeof(Color4));
+}
+
+// Builds the table used by decodePalettedRow, mapping each possible byte of a row to the colors 
+// of the 1, 2, 4 or 8 pixels it packs (in left-to-right pixel order).
+//
+// predicate: palette has maxPaletteSize colors so any index is valid.
+void Image::buildByteColorTable(int bitsPerPixel, const std::vector<Color4>& palette, 
+                                std::vector<Color4>& byteColors)
+{
+  const PaletteIndexTable& indexTable = paletteIndexTables[calculatePaletteIndexTableNo(bitsPerPixel)];
+  int numPixelsPerByte = 8 / bitsPerPixel;
+  byteColors.resize(256 * numPixelsPerByte);
+  for(int byte = 0; byte < 256; ++byte)
+    for(int i = 0; i < numPixelsPerByte; ++i)
+      byteColors[(byte * numPixelsPerByte) + i] = palette[indexTable._indices[byte][i]];
+}
+
+
+// A sprite represents a color image that can be drawn on a virtual screen. Pixels on the sprite
+// are positioned on a coordinate space mapped as shown below.
+//
+//         row
+//          ^
+//          |
+//          |
+//   origin o----> col
+//
+// A sprite either owns its pixels or is a view of pixels owned elsewhere (e.g. a memory mapped
+// sprite pack); views are cheap to create and copy but cannot be modified and must not outlive
+// the pixels they view.
+//
+class Sprite
+{
+public:
+  Sprite();
+  Sprite(std::vector<Color4> pixels, int width, int height);
+  Sprite(const Color4* pixels, int width, int height);
+  ~Sprite() = default;
+  Sprite(const Sprite& other);
+  Sprite(Sprite&&) = default;
+  Sprite& operator=(const Sprite& other);
+  Sprite& operator=(Sprite&&) = default;
+  void setPixel(int row, int col, const Color4& color);
+  const Color4* getPixels() const {return _view;}
+  int getWidth() const {return _width;}
+  int getHeight() const {return _height;}
+  bool isView() const {return _view != _pixels.data();}
+private:
+  std::vector<Color4> _pixels;    // empty for views.
+  const Color4* _view;            // the sprite's pixels; either _pixels.data() or external.
+  int _width;
+  int _height;
+};
+
+Sprite::Sprite() :
+  _pixels{},
+  _view{nullptr},
+  _width{0},
+  _height{0}
+{}
+
+Sprite::Sprite(std::vector<Color4> pixels, int width, int height) : 
+  _pixels{std::move(pixels)},
+  _view{_pixels.data()},
+  _width{width},
+  _height{height}
+{}
+
+Sprite::Sprite(const Color4* pixels, int width, int height) : 
+  _pixels{},
+  _view{pixels},
+  _width{width},
+  _height{height}
+{}
+
+// note: moves need no special handling since moving a vector keeps its buffer (so the view
+// remains valid), copies of owning sprites must however view their own copy of the pixels.
+Sprite::Sprite(const Sprite& other) :
+  _pixels{other._pixels},
+  _view{other.isView() ? other._view : _pixels.data()},
+  _width{other._width},
+  _height{other._height}
+{}
+
+Sprite& Sprite::operator=(const Sprite& other)
+{
+  _pixels = other._pixels;
+  _view = other.isView() ? other._view : _pixels.data();
+  _width = other._width;
+  _height = other._height;
+  return *this;
+}
+
+void Sprite::setPixel(int row, int col, const Color4& color)
+{
+  assert(!isView());
+  _pixels[col + (row * _width)] = color;
+}
+
+// A sprite with transparent pixels, compiled from a sprite into rows of spans; each span skips
+// a run of transparent pixels then copies a run of opaque pixels. Only the opaque pixels are
+// stored (packed in span order), so drawing costs in proportion to the opaque pixels rather
+// than the sprite's bounding box.
+//
+// Which pixels are transparent is set by the key:
+//
+//   KEY_COLOR - pixels equal to the color key are transparent.
+//
+//   KEY_ALPHA - pixels with an alpha below alphaThreshold are transparent; all others are drawn
+//               opaque (there is no blending).
+//
+// Transparent pixels at the end of a row need no span.
+//
+class TransparentSprite
+{
+public:
+  enum Key { KEY_COLOR, KEY_ALPHA };
+  struct Span
+  {
+    uint16_t _skip;               // num transparent pixels before the opaque pixels.
+    uint16_t _length;             // num opaque pixels.
+  };
+public:
+  TransparentSprite();
+  TransparentSprite(const Sprite& sprite, Key key, const Color4& colorKey = Color4{});
+  ~TransparentSprite() = default;
+  const Span* getSpans(int row) const {return _spans.data() + _rowSpans[row];}
+  int getNumSpans(int row) const {return _rowSpans[row + 1] - _rowSpans[row];}
+  const Color4* getPixels(int row) const {return _pixels.data() + _rowPixels[row];}
+  int getWidth() const {return _width;}
+  int getHeight() const {return _height;}
+  int getNumOpaquePixels() const {return static_cast<int>(_pixels.size());}
+private:
+  static constexpr uint8_t alphaThreshold {128};
+private:
+  std::vector<Span> _spans;
+  std::vector<int> _rowSpans;     // index of each row's first span; has height + 1 entries.
+  std::vector<int> _rowPixels;    // index of each row's first opaque pixel.
+  std::vector<Color4> _pixels;    // the opaque pixels.
+  int _width;
+  int _height;
+};
+
+// Compiles rows of pixels into the spans of a transparent sprite: each row's spans skip runs of
+// pixels which are not opaque and copy runs which are; the opaque pixels are stored in span order.
+template<typename Pixel_t, typename IsOpaque_t>
+void compileSpans(const Pixel_t* pixels, int width, int height, IsOpaque_t isOpaque, 
+                  std::vector<TransparentSprite::Span>& spans, std::vector<int>& rowSpans, 
+                  std::vector<int>& rowPixels, std::vector<Pixel_t>& opaquePixels)
+{
+  assert(width <= std::numeric_limits<uint16_t>::max());
+
+  rowSpans.reserve(height + 1);
+  rowPixels.reserve(height);
+  const Pixel_t* row = pixels;
+  for(int i = 0; i < height; ++i, row += width){
+    rowSpans.push_back(static_cast<int>(spans.size()));
+    rowPixels.push_back(static_cast<int>(opaquePixels.size()));
+    int col {0};
+    while(col < width){
+      int skipStart = col;
+      while(col < width && !isOpaque(row[col]))
+        ++col;
+      int opaqueStart = col;
+      while(col < width && isOpaque(row[col]))
+        ++col;
+      if(col == opaqueStart)
+        break;
+      spans.push_back(TransparentSprite::Span{static_cast<uint16_t>(opaqueStart - skipStart), 
+                                              static_cast<uint16_t>(col - opaqueStart)});
+      opaquePixels.insert(opaquePixels.end(), row + opaqueStart, row + col);
+    }
+  }
+  rowSpans.push_back(static_cast<int>(spans.size()));
+}
+
+TransparentSprite::TransparentSprite() :
+  _spans{},
+  _rowSpans{0},
+  _rowPixels{},
+  _pixels{},
+  _width{0},
+  _height{0}
+{}
+
+TransparentSprite::TransparentSprite(const Sprite& sprite, Key key, const Color4& colorKey) :
+  _spans{},
+  _rowSpans{},
+  _rowPixels{},
+  _pixels{},
+  _width{sprite.getWidth()},
+  _height{sprite.getHeight()}
+{
+  auto isOpaque = [key, colorKey](const Color4& pixel){
+    return (key == KEY_COLOR) ? pixel != colorKey : pixel.getAlpha() >= alphaThreshold;
+  };
+  compileSpans(sprite.getPixels(), _width, _height, isOpaque, 
+               _spans, _rowSpans, _rowPixels, _pixels);
+}
+
+// A sprite of palette indices for drawing on an indexed screen; see Screen::COLOR_INDEXED. As a
+// TransparentSprite it is compiled into rows of spans of opaque pixels (here indices) and only
+// the opaque pixels are stored and drawn. Pixels of transparentIndex are transparent, so the 
+// palette of a screen drawn with transparent sprites may have at most 255 colors.
+//
+// Sprites are indexed from colored sprites by finding each pixel's color in the palette; pixels
+// of the color key are transparent. Colors not in the palette cannot be drawn; their pixels are
+// made transparent and counted so the caller can report them.
+class IndexedSprite
+{
+public:
+  using Span = TransparentSprite::Span;
+  static constexpr uint8_t transparentIndex {255};
+public:
+  IndexedSprite();
+  IndexedSprite(const std::vector<uint8_t>& indices, int width, int height);
+  IndexedSprite(const Sprite& sprite, const Color4* palette, int numColors, const Color4& colorKey);
+  ~IndexedSprite() = default;
+  const Span* getSpans(int row) const {return _spans.data() + _rowSpans[row];}
+  int getNumSpans(int row) const {return _rowSpans[row + 1] - _rowSpans[row];}
+  const uint8_t* getPixels(int row) const {return _pixels.data() + _rowPixels[row];}
+  int getWidth() const {return _width;}
+  int getHeight() const {return _height;}
+  int getNumUnmappedPixels() const {return _numUnmappedPixels;}
+private:
+  static bool isOpaque(uint8_t index) {return index != transparentIndex;}
+private:
+  std::vector<Span> _spans;
+  std::vector<int> _rowSpans;     // index of each row's first span; has height + 1 entries.
+  std::vector<int> _rowPixels;    // index of each row's first opaque pixel.
+  std::vector<uint8_t> _pixels;   // the opaque pixels.
+  int _width;
+  int _height;
+  int _numUnmappedPixels;         // of colors not in the palette.
+};
+
+IndexedSprite::IndexedSprite() :
+  _spans{},
+  _rowSpans{0},
+  _rowPixels{},
+  _pixels{},
+  _width{0},
+  _height{0},
+  _numUnmappedPixels{0}
+{}
+
+IndexedSprite::IndexedSprite(const std::vector<uint8_t>& indices, int width, int height) :
+  _spans{},
+  _rowSpans{},
+  _rowPixels{},
+  _pixels{},
+  _width{width},
+  _height{height},
+  _numUnmappedPixels{0}
+{
+  assert(static_cast<int>(indices.size()) == width * height);
+  compileSpans(indices.data(), _width, _height, isOpaque, 
+               _spans, _rowSpans, _rowPixels, _pixels);
+}
+
+IndexedSprite::IndexedSprite(const Sprite& sprite, const Color4* palette, int numColors, 
+                             const Color4& colorKey) :
+  _spans{},
+  _rowSpans{},
+  _rowPixels{},
+  _pixels{},
+  _width{sprite.getWidth()},
+  _height{sprite.getHeight()},
+  _numUnmappedPixels{0}
+{
+  assert(numColors <= transparentIndex);
+  std::vector<uint8_t> indices(_width * _height, transparentIndex);
+  const Color4* pixels = sprite.getPixels();
+  for(size_t i = 0; i < indices.size(); ++i){
+    if(pixels[i] == colorKey)
+      continue;
+    const Color4* color = std::find(palette, palette + numColors, pixels[i]);
+    if(color != palette + numColors)
+      indices[i] = static_cast<uint8_t>(color - palette);
+    else
+      ++_numUnmappedPixels;
+  }
+  compileSpans(indices.data(), _width, _height, isOpaque, 
+               _spans, _rowSpans, _rowPixels, _pixels);
+}
+
+// Expands a run of palette indices into colors; the palette must have 256 entries.
+using IndexExpander_t = void (*)(const uint8_t*, int, const Color4*, Color4*);
+
+void expandIndices(const uint8_t* indices, int count, const Color4* palette, Color4* colors)
+{
+  for(int i = 0; i < count; ++i)
+    colors[i] = palette[indices[i]];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// expands 8 indices per iteration with a gather of the (4-byte) palette colors.
+__attribute__((target("avx2")))
+void expandIndicesAvx2(const uint8_t* indices, int count, const Color4* palette, Color4* colors)
+{
+  const int* table = reinterpret_cast<const int*>(palette);
+  int i {0};
+  for(; i + 8 <= count; i += 8){
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i));
+    __m256i gathered = _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(bytes), 4);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(colors + i), gathered);
+  }
+  expandIndices(indices + i, count - i, palette, colors + i);
+}
+
+#endif
+
+IndexExpander_t selectIndexExpander()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(std::min(detectSimdLevel(), maxSimdLevel) == SIMD_AVX2)
+    return &expandIndicesAvx2;
+#endif
+  return &expandIndices;
+}
+
+// A small bounded set of rectangles covering a region, e.g. the pixels of a screen changed since
+// it was last rendered. Rects are merged with an existing rect whenever the merged rect covers
+// no more area than the two rects did, and when the set is full a new rect merges with the rect
+// it grows least. Thus the set may cover more than the region added to it, but never less.
+class RectSet
+{
+public:
+  RectSet() : _rects{}, _numRects{0}{}
+  void add(iRect rect);
+  void clear() {_numRects = 0;}
+  const iRect* getRects() const {return _rects.data();}
+  int getNumRects() const {return _numRects;}
+  int32_t getArea() const;
+private:
+  static constexpr int maxRects {16};
+private:
+  std::array<iRect, maxRects> _rects;
+  int _numRects;
+};
+
+void RectSet::add(iRect rect)
+{
+  if(rect.isEmpty())
+    return;
+
+  int bestRectNo {-1};
+  int32_t bestGrowth {std::numeric_limits<int32_t>::max()};
+  for(int i = 0; i < _numRects; ++i){
+    int32_t growth = _rects[i].united(rect).area() - _rects[i].area() - rect.area();
+    if(growth < bestGrowth){
+      bestGrowth = growth;
+      bestRectNo = i;
+    }
+  }
+
+  if(bestRectNo != -1 && (bestGrowth <= 0 || _numRects == maxRects))
+    _rects[bestRectNo] = _rects[bestRectNo].united(rect);
+  else
+    _rects[_numRects++] = rect;
+}
+
+int32_t RectSet::getArea() const
+{
+  int32_t area {0};
+  for(int i = 0; i < _numRects; ++i)
+    area += _rects[i].area();
+  return area;
+}
+
+// A virtual screen with fixed resolution independent of display resolution and window size. The
+// screen is positioned centrally in the window with the ratio of virtual pixel size to real
+// pixel size being calculated to fit the window dimensions.
+//
+// Pixels on the screen are arranged on a coordinate system with the origin in the bottom left
 // most corner, rows ascending north and columns ascending east as shown below.
 //
-//      row
-//       ^
-//       |
-//       |
-//   pos o----> col
+//      row
+//       ^
+//       |
+//       |
+//   pos o----> col
+//
+// note: virtual pixel sizes are limited to integer mulitiples of real pixels, i.e. integers.
+//
+// The screen is drawn on the main thread and rendered on the render thread. At the end of each
+// frame the screen is captured into a Frame (a snapshot of its pixels and the regions changed
+// since the last capture) which is handed to the render thread and rendered by a 
+// ScreenPresenter. The pixels are thus free to be drawn again while the frame renders. Frames 
+// are reused, so a capture copies only the regions changed since the frame was last captured.
+//
+// The screen tracks the regions of pixels changed (dirty) since it was last captured so the 
+// renderer need only upload those regions. To keep the dirty region small when the screen is 
+// cleared every frame, the screen also tracks the regions drawn since the last clear; clearing
+// to the same color as the last clear then need only reset (and dirty) those regions.
+//
+// The screen stores its pixels in one of two color modes, fixed at construction:
+//
+//   COLOR_DIRECT  - pixels are 4 byte colors drawn with the Color4 draw functions.
+//
+//   COLOR_INDEXED - pixels are 1 byte indices into a 256 color palette drawn with the index
+//                   draw functions. Indices are expanded to colors when rendered (only the
+//                   dirty regions in texture mode), so drawing moves (and the screen and its 
+//                   frames hold) a quarter of the bytes and changing the palette recolors the 
+//                   screen without redrawing it.
+//
+// note: in indexed mode the points render mode expands all pixels every render.
+//
+class Screen
+{
+public:
+  static constexpr int screenWidth = 160;
+  static constexpr int screenHeight = 160;
+  static constexpr int pixelCount = screenWidth * screenHeight;
+  static constexpr iRect screenRect {0, 0, screenWidth, screenHeight};
+public:
+  enum ColorMode { COLOR_DIRECT, COLOR_INDEXED };
+  struct Frame
+  {
+    ColorMode _colorMode;
+    Renderer::RenderMode _renderMode;
+    std::vector<Color4> _colors;                 // direct mode only.
+    std::vector<uint8_t> _indices;               // indexed mode only.
+    std::vector<Color4> _palette;                // indexed mode only.
+    RectSet _dirtyRects;                         // changed since the previous frame.
+    Vector2i _windowSize;
+    Vector2i _position;
+    int _pixelSize;
+    int64_t _positionsVersion;                   // changes when _position or _pixelSize do.
+    int64_t _captureNo {-1};                     // of the capture last into the frame.
+  };
+public:
+  Screen(Vector2i windowSize, ColorMode colorMode = COLOR_DIRECT);
+  ~Screen() = default;
+  ColorMode getColorMode() const {return _colorMode;}
+  int getWidth() const {return screenWidth;}
+  int getHeight() const {return screenHeight;}
+  void clear(const Color4& color);
+  void clear(iRect region, const Color4& color);
+  void drawPixel(int row, int col, const Color4& color);
+  void drawSprite(int x, int y, const Sprite& sprite);
+  void drawSprite(int x, int y, const TransparentSprite& sprite);
+  void setPalette(const Color4* colors, int numColors);
+  void clear(uint8_t index);
+  void clear(iRect region, uint8_t index);
+  void drawPixel(int row, int col, uint8_t index);
+  void drawSprite(int x, int y, const IndexedSprite& sprite);
+  void rescalePixels(Vector2i windowSize);
+  void capture(Frame& frame);
+private:
+  template<typename Pixel_t> void clearPixels(Pixel_t* pixels, const Pixel_t& value, Pixel_t& clearValue);
+  template<typename Pixel_t> void clearPixels(Pixel_t* pixels, iRect region, const Pixel_t& value, 
+                                              const Pixel_t& clearValue);
+  template<typename Pixel_t> static void fillPixels(Pixel_t* pixels, iRect region, const Pixel_t& value);
+  template<typename Pixel_t> static void copyPixels(Pixel_t* dst, const Pixel_t* src, iRect region);
+  template<typename Pixel_t> void drawPixel(Pixel_t* pixels, int row, int col, const Pixel_t& value);
+  template<typename Pixel_t> void blitPixels(Pixel_t* pixels, int x, int y, const Pixel_t* spritePixels,
+                                             int spriteWidth, int spriteHeight);
+  template<typename Pixel_t, typename Sprite_t> void blitSpans(Pixel_t* pixels, int x, int y, 
+                                                               const Sprite_t& sprite);
+private:
+  static constexpr int captureHistorySize {8};
+private:
+  ColorMode _colorMode;
+  Vector2i _windowSize;
+  Vector2i _position;
+  // only the buffers of the screen's color mode are allocated.
+  std::vector<Color4> _colors;                 // flattened 2D array accessed (col + (row * width))
+  std::vector<uint8_t> _indices;               // indexed mode only; same layout.
+  std::vector<Color4> _palette;                // indexed mode only; 256 colors.
+  int _pixelSize;
+  int64_t _positionsVersion;
+  RectSet _dirtyRects;                   // changed since the last capture.
+  RectSet _drawnRects;                   // drawn since the last clear.
+  std::array<RectSet, captureHistorySize> _capturedRects;  // dirty rects of recent captures.
+  int64_t _numCaptures;
+  Color4 _clearColor;
+  uint8_t _clearIndex;
+  bool _isCleared;                       // true if all pixels outside _drawnRects are the clear value.
+};
+
+Screen::Screen(Vector2i windowSize, ColorMode colorMode) :
+  _colorMode{colorMode},
+  _positionsVersion{0},
+  _dirtyRects{},
+  _drawnRects{},
+  _capturedRects{},
+  _numCaptures{0},
+  _clearColor{},
+  _clearIndex{0},
+  _isCleared{false}
+{
+  if(colorMode == COLOR_INDEXED){
+    _indices.assign(pixelCount, 0);
+    _palette.assign(256, Color4{});
+  }
+  else
+    _colors.assign(pixelCount, Color4{});
+  _dirtyRects.add(screenRect);
+  rescalePixels(windowSize);
+}
+
+template<typename Pixel_t>
+void Screen::clearPixels(Pixel_t* pixels, const Pixel_t& value, Pixel_t& clearValue)
+{
+  if(_isCleared && value == clearValue){
+    for(int i = 0; i < _drawnRects.getNumRects(); ++i){
+      fillPixels(pixels, _drawnRects.getRects()[i], value);
+      _dirtyRects.add(_drawnRects.getRects()[i]);
+    }
+  }
+  else{
+    std::fill_n(pixels, pixelCount, value);
+    _dirtyRects.clear();
+    _dirtyRects.add(screenRect);
+    clearValue = value;
+    _isCleared = true;
+  }
+  _drawnRects.clear();
+}
+
+template<typename Pixel_t>
+void Screen::clearPixels(Pixel_t* pixels, iRect region, const Pixel_t& value, const Pixel_t& clearValue)
+{
+  region = region.intersected(screenRect);
+  if(region.isEmpty())
+    return;
+  fillPixels(pixels, region, value);
+  _dirtyRects.add(region);
+  if(value != clearValue)
+    _drawnRects.add(region);
+}
+
+template<typename Pixel_t>
+void Screen::fillPixels(Pixel_t* pixels, iRect region, const Pixel_t& value)
+{
+  if(region._x == 0 && region._w == screenWidth){
+    std::fill_n(pixels + (region._y * screenWidth), region._h * screenWidth, value);
+    return;
+  }
+  for(int row = region._y; row < region._y + region._h; ++row)
+    std::fill_n(pixels + region._x + (row * screenWidth), region._w, value);
+}
+
+template<typename Pixel_t>
+void Screen::copyPixels(Pixel_t* dst, const Pixel_t* src, iRect region)
+{
+  for(int row = region._y; row < region._y + region._h; ++row){
+    int index = region._x + (row * screenWidth);
+    std::memcpy(dst + index, src + index, region._w * sizeof(Pixel_t));
+  }
+}
+
+template<typename Pixel_t>
+void Screen::drawPixel(Pixel_t* pixels, int row, int col, const Pixel_t& value)
+{
+  assert(0 <= row && row < screenHeight);
+  assert(0 <= col && col < screenWidth);
+  pixels[col + (row * screenWidth)] = value;
+  _dirtyRects.add(iRect{col, row, 1, 1});
+  _drawnRects.add(iRect{col, row, 1, 1});
+}
+
+// Sprites may be positioned partially (or wholly) off any edge of the screen; the visible part 
+// of the sprite is found once by intersecting the sprite's rect with the screen and each of its
+// rows is then copied as one block.
+template<typename Pixel_t>
+void Screen::blitPixels(Pixel_t* pixels, int x, int y, const Pixel_t* spritePixels, 
+                        int spriteWidth, int spriteHeight)
+{
+  iRect visible = iRect{x, y, spriteWidth, spriteHeight}.intersected(screenRect);
+  if(visible.isEmpty())
+    return;
+
+  _dirtyRects.add(visible);
+  _drawnRects.add(visible);
+
+  spritePixels += (visible._x - x) + ((visible._y - y) * spriteWidth);
+  Pixel_t* screenPixels = pixels + visible._x + (visible._y * screenWidth);
+  for(int row = 0; row < visible._h; ++row){
+    std::memcpy(screenPixels, spritePixels, visible._w * sizeof(Pixel_t));
+    spritePixels += spriteWidth;
+    screenPixels += screenWidth;
+  }
+}
+
+void Screen::clear(const Color4& color)
+{
+  assert(_colorMode == COLOR_DIRECT);
+  clearPixels(_colors.data(), color, _clearColor);
+}
+
+void Screen::clear(iRect region, const Color4& color)
+{
+  assert(_colorMode == COLOR_DIRECT);
+  clearPixels(_colors.data(), region, color, _clearColor);
+} 
+
+void Screen::drawPixel(int row, int col, const Color4& color)
+{
+  assert(_colorMode == COLOR_DIRECT);
+  drawPixel(_colors.data(), row, col, color);
+}
+
+void Screen::drawSprite(int x, int y, const Sprite& sprite)
+{
+  assert(_colorMode == COLOR_DIRECT);
+  blitPixels(_colors.data(), x, y, sprite.getPixels(), sprite.getWidth(), sprite.getHeight());
+}
+
+// Draws only the opaque pixels of the sprite; the transparent pixels are skipped over without
+// being read or written. Clipped as the opaque sprites are, with spans cut to the visible cols.
+template<typename Pixel_t, typename Sprite_t>
+void Screen::blitSpans(Pixel_t* pixels, int x, int y, const Sprite_t& sprite)
+{
+  iRect visible = iRect{x, y, sprite.getWidth(), sprite.getHeight()}.intersected(screenRect);
+  if(visible.isEmpty())
+    return;
+
+  _dirtyRects.add(visible);
+  _drawnRects.add(visible);
+
+  // visible cols in sprite space, [col0, col1).
+  int col0 = visible._x - x;
+  int col1 = col0 + visible._w;
+
+  for(int spriteRow = visible._y - y; spriteRow < visible._y - y + visible._h; ++spriteRow){
+    Pixel_t* screenPixels = pixels + ((y + spriteRow) * screenWidth);
+    const TransparentSprite::Span* spans = sprite.getSpans(spriteRow);
+    const Pixel_t* spritePixels = sprite.getPixels(spriteRow);
+    int numSpans = sprite.getNumSpans(spriteRow);
+    int col {0};
+    for(int i = 0; i < numSpans; ++i){
+      col += spans[i]._skip;
+      if(col >= col1)
+        break;
+      int spanEnd = col + spans[i]._length;
+      int start = std::max(col, col0);
+      if(start < spanEnd){
+        int end = std::min(spanEnd, col1);
+        std::memcpy(screenPixels + x + start, spritePixels + (start - col), (end - start) * sizeof(Pixel_t));
+      }
+      spritePixels += spans[i]._length;
+      col = spanEnd;
+    }
+  }
+}
+
+void Screen::drawSprite(int x, int y, const TransparentSprite& sprite)
+{
+  assert(_colorMode == COLOR_DIRECT);
+  blitSpans(_colors.data(), x, y, sprite);
+}
+
+// Sets the palette of an indexed screen; entries beyond numColors are black. The whole screen 
+// is recolored on the next render.
+void Screen::setPalette(const Color4* colors, int numColors)
+{
+  assert(_colorMode == COLOR_INDEXED);
+  assert(0 <= numColors && numColors <= static_cast<int>(_palette.size()));
+  std::fill(_palette.begin(), _palette.end(), Color4{});
+  std::copy(colors, colors + numColors, _palette.begin());
+  _dirtyRects.clear();
+  _dirtyRects.add(screenRect);
+}
+
+void Screen::clear(uint8_t index)
+{
+  assert(_colorMode == COLOR_INDEXED);
+  clearPixels(_indices.data(), index, _clearIndex);
+}
+
+void Screen::clear(iRect region, uint8_t index)
+{
+  assert(_colorMode == COLOR_INDEXED);
+  clearPixels(_indices.data(), region, index, _clearIndex);
+}
+
+void Screen::drawPixel(int row, int col, uint8_t index)
+{
+  assert(_colorMode == COLOR_INDEXED);
+  drawPixel(_indices.data(), row, col, index);
+}
+
+void Screen::drawSprite(int x, int y, const IndexedSprite& sprite)
+{
+  assert(_colorMode == COLOR_INDEXED);
+  blitSpans(_indices.data(), x, y, sprite);
+}
+
+void Screen::rescalePixels(Vector2i windowSize)
+{
+  int pixelWidth = windowSize._x / screenWidth; 
+  int pixelHeight = windowSize._y / screenHeight;
+  _pixelSize = std::min(pixelWidth, pixelHeight);
+  if(_pixelSize == 0)
+    _pixelSize = 1;
+  _position._x = std::clamp((windowSize._x - (_pixelSize * screenWidth)) / 2, 0, windowSize._x);
+  _position._y = std::clamp((windowSize._y - (_pixelSize * screenHeight)) / 2, 0, windowSize._y);
+  _windowSize = windowSize;
+  ++_positionsVersion;
+}
+
+// Captures the screen into the frame; the frame's dirty regions are those changed since the 
+// last capture. 
+//
+// Only the pixels changed since the frame was last captured into are copied; these are the 
+// dirty regions of the captures since, which the screen keeps for its last few captures. A 
+// frame older than that (or never captured into) is copied whole.
+void Screen::capture(Frame& frame)
+{
+  _capturedRects[_numCaptures % captureHistorySize] = _dirtyRects;
+  RectSet copyRects {};
+  if(frame._captureNo < 0 || _numCaptures - frame._captureNo > captureHistorySize)
+    copyRects.add(screenRect);
+  else{
+    for(int64_t captureNo = frame._captureNo + 1; captureNo <= _numCaptures; ++captureNo){
+      const RectSet& rects = _capturedRects[captureNo % captureHistorySize];
+      for(int i = 0; i < rects.getNumRects(); ++i)
+        copyRects.add(rects.getRects()[i]);
+    }
+  }
+
+  frame._colorMode = _colorMode;
+  if(_colorMode == COLOR_INDEXED)
+    frame._indices.resize(pixelCount);        // allocates only on the first capture.
+  else
+    frame._colors.resize(pixelCount);
+  for(int i = 0; i < copyRects.getNumRects(); ++i){
+    if(_colorMode == COLOR_INDEXED)
+      copyPixels(frame._indices.data(), _indices.data(), copyRects.getRects()[i]);
+    else
+      copyPixels(frame._colors.data(), _colors.data(), copyRects.getRects()[i]);
+  }
+  if(_colorMode == COLOR_INDEXED)
+    frame._palette = _palette;
+  frame._captureNo = _numCaptures++;
+  frame._dirtyRects = _dirtyRects;
+  frame._windowSize = _windowSize;
+  frame._position = _position;
+  frame._pixelSize = _pixelSize;
+  frame._positionsVersion = _positionsVersion;
+  _dirtyRects.clear();
+}
+
+// Renders captured screen frames; used only by the thread which owns the opengl context.
+//
+// The pixel colors and positions are sent to the renderer separately; the colors are sent with
+// every frame, whereas the positions (points mode only) are recalculated and sent only when the
+// frame's positions version differs from that last sent.
+class ScreenPresenter
+{
+public:
+  struct Stats
+  {
+    int64_t _numFrames;
+    int64_t _numDirtyRects;     // totals over all frames.
+    int64_t _numDirtyPixels;
+    int _maxDirtyPixels;        // of any one frame.
+  };
+public:
+  ScreenPresenter();
+  ~ScreenPresenter() = default;
+  void present(const Screen::Frame& frame);
+  const Stats& getStats() const {return _stats;}
+private:
+  void updatePositions(const Screen::Frame& frame);
+private:
+  static constexpr int screenWidth {Screen::screenWidth};
+  static constexpr int screenHeight {Screen::screenHeight};
+  static constexpr int pixelCount {Screen::pixelCount};
+private:
+  std::array<float, pixelCount * 2> _positions;  // (x, y) pairs of the pixel centers.
+  std::vector<Color4> _colors;                   // expanded indexed frames (points mode only).
+  int64_t _positionsVersion;
+  IndexExpander_t _expandIndices;
+  Stats _stats;
+};
+
+ScreenPresenter::ScreenPresenter() :
+  _positionsVersion{-1},
+  _expandIndices{selectIndexExpander()},
+  _stats{0, 0, 0, 0}
+{}
+
+void ScreenPresenter::updatePositions(const Screen::Frame& frame)
+{
+  int pixelCenterOffset = frame._pixelSize / 2;
+  float* position = _positions.data();
+  for(int row = 0; row < screenHeight; ++row){
+    float y = frame._position._y + (row * frame._pixelSize) + pixelCenterOffset;
+    for(int col = 0; col < screenWidth; ++col){
+      *position++ = frame._position._x + (col * frame._pixelSize) + pixelCenterOffset;
+      *position++ = y;
+    }
+  }
+  sk::renderer->setPixelPositions(_positions.data(), pixelCount);
+  _positionsVersion = frame._positionsVersion;
+}
+
+void ScreenPresenter::present(const Screen::Frame& frame)
+{
+  const RectSet* dirtyRects = &frame._dirtyRects;
+  bool isIndexed = (frame._colorMode == Screen::COLOR_INDEXED);
+  if(sk::renderer->getRenderMode() == Renderer::RENDER_TEXTURE){
+    Color4* colors = sk::renderer->mapScreenTexture(screenWidth, screenHeight);
+    RectSet wholeScreen {};
+    if(!sk::renderer->isScreenTextureValid()){
+      wholeScreen.add(Screen::screenRect);
+      dirtyRects = &wholeScreen;
+    }
+    for(int i = 0; i < dirtyRects->getNumRects(); ++i){
+      const iRect& rect = dirtyRects->getRects()[i];
+      for(int row = rect._y; row < rect._y + rect._h; ++row){
+        int index = rect._x + (row * screenWidth);
+        if(isIndexed)
+          _expandIndices(frame._indices.data() + index, rect._w, frame._palette.data(), colors + index);
+        else
+          std::memcpy(colors + index, frame._colors.data() + index, rect._w * sizeof(Color4));
+      }
+    }
+    sk::renderer->drawScreenTexture(iRect{frame._position._x, frame._position._y, 
+                                          screenWidth * frame._pixelSize, 
+                                          screenHeight * frame._pixelSize}, 
+                                    dirtyRects->getRects(), dirtyRects->getNumRects());
+  }
+  else{
+    // note: the window is cleared every frame so all points must be redrawn.
+    if(_positionsVersion != frame._positionsVersion)
+      updatePositions(frame);
+    const Color4* colors = frame._colors.data();
+    if(isIndexed){
+      _colors.resize(pixelCount);
+      _expandIndices(frame._indices.data(), pixelCount, frame._palette.data(), _colors.data());
+      colors = _colors.data();
+    }
+    sk::renderer->drawPixelArray(0, pixelCount, colors, frame._pixelSize);
+  }
+
+  int numDirtyPixels = std::min(dirtyRects->getArea(), pixelCount);
+  ++_stats._numFrames;
+  _stats._numDirtyRects += dirtyRects->getNumRects();
+  _stats._numDirtyPixels += numDirtyPixels;
+  _stats._maxDirtyPixels = std::max(_stats._maxDirtyPixels, numDirtyPixels);
+}
+
+std::unique_ptr<Screen> screen {nullptr};
+
+#endif // SK_SIM_ONLY
+
+//------------------------------------------------------------------------------------------------
+//  ASSETS                                                                                        
+//------------------------------------------------------------------------------------------------
+
+// A fixed set of worker threads which run queued jobs in FIFO order.
+class WorkerPool
+{
+public:
+  using Job_t = std::function<void()>;
+public:
+  WorkerPool(int numWorkers);
+  ~WorkerPool();
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+  void submit(Job_t job);
+  int getNumWorkers() const {return static_cast<int>(_workers.size());}
+private:
+  void workerMain();
+private:
+  std::vector<std::thread> _workers;
+  std::deque<Job_t> _jobs;
+  std::mutex _jobsMutex;
+  std::condition_variable _jobsCondition;
+  bool _isDone;
+};
+
+WorkerPool::WorkerPool(int numWorkers) :
+  _isDone{false}
+{
+  assert(numWorkers > 0);
+  for(int i = 0; i < numWorkers; ++i)
+    _workers.emplace_back(&WorkerPool::workerMain, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock {_jobsMutex};
+    _isDone = true;
+  }
+  _jobsCondition.notify_all();
+  for(auto& worker : _workers)
+    worker.join();
+}
+
+void WorkerPool::submit(Job_t job)
+{
+  {
+    std::lock_guard<std::mutex> lock {_jobsMutex};
+    _jobs.push_back(std::move(job));
+  }
+  _jobsCondition.notify_one();
+}
+
+void WorkerPool::workerMain()
+{
+  while(true){
+    Job_t job;
+    {
+      std::unique_lock<std::mutex> lock {_jobsMutex};
+      _jobsCondition.wait(lock, [this](){return _isDone || !_jobs.empty();});
+      if(_jobs.empty())
+        return;                                      // done and all jobs finished.
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+    job();
+  }
+}
+
+#ifndef SK_SIM_ONLY
+
+// Decodes assets on a pool of worker threads. Loads are requested up front (e.g. from an asset
+// manifest) and return a handle immediately; the caller can do other work (e.g. creating the 
+// window) and later wait on the handles to collect the results. Since all assets decode 
+// concurrently, the total wait is bounded by the slowest asset rather than the sum of all.
+class AssetLoader
+{
+public:
+  using Handle_t = int;
+public:
+  AssetLoader();
+  ~AssetLoader() = default;
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+  Handle_t loadBmp(std::string filename);
+  int wait(Handle_t handle, Image& image);
+private:
+  struct Asset
+  {
+    std::string _filename;
+    Image _image;
+    std::future<int> _result;
+  };
+private:
+  static constexpr int maxWorkers {8};
+private:
+  // assets are heap allocated so their addresses are stable while workers write to them.
+  std::vector<std::unique_ptr<Asset>> _assets;
+  WorkerPool _workers;
+};
+
+AssetLoader::AssetLoader() :
+  _assets{},
+  _workers{std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, maxWorkers)}
+{}
+
+AssetLoader::Handle_t AssetLoader::loadBmp(std::string filename)
+{
+  _assets.push_back(std::make_unique<Asset>());
+  Asset* asset = _assets.back().get();
+  asset->_filename = std::move(filename);
+
+  auto promise = std::make_shared<std::promise<int>>();
+  asset->_result = promise->get_future();
+  _workers.submit([asset, promise](){
+    promise->set_value(asset->_image.loadBmpMapped(asset->_filename));
+  });
+
+  return static_cast<Handle_t>(_assets.size() - 1);
+}
+
+// Blocks until the asset is loaded then moves it into image. Returns -1 if the asset failed to
+// load (the failure is logged). Each handle can only be waited on once.
+int AssetLoader::wait(Handle_t handle, Image& image)
+{
+  assert(0 <= handle && handle < static_cast<Handle_t>(_assets.size()));
+  Asset& asset = *_assets[handle];
+  assert(asset._result.valid());
+  if(asset._result.get() != 0){
+    sk::log->log(Log::ERROR, logstr::fail_load_asset, asset._filename);
+    return -1;
+  }
+  image = std::move(asset._image);
+  return 0;
+}
+
+std::unique_ptr<AssetLoader> assetLoader {nullptr};
+
+// SPRITE PACK FORMAT (.skpak)
+//
+// A sprite pack holds sprites pre-decoded (by the skpack tool) so they can be used directly from
+// a memory mapping of the pack without any parsing, decoding or copying. The layout is:
+//
+//   +-------------------+  offset 0
+//   | SpritePackHeader  |
+//   +-------------------+  offset sizeof(SpritePackHeader)
+//   | SpritePackEntry[] |  one per sprite, sorted by name (strcmp order) for binary search.
+//   +-------------------+
+//   | pixel blocks      |  each starts on a spritePackAlignment byte boundary.
+//   +-------------------+
+//
+// A pixel block holds either raw Color4 pixels (in Sprite order; bottom row first) or, if its 
+// entry is compressed, RLE runs of identical pixels (SpritePackRun).
+//
+// note: unlike the bmp headers these structs are read by casting the mapped bytes, thus all 
+// fields are fixed width, naturally aligned and little-endian; packs are rejected on big-endian
+// systems.
+
+struct SpritePackHeader
+{
+  static constexpr uint32_t packMagic {0x4b504b53};          // "SKPK" in little-endian.
+  static constexpr uint32_t packVersion {1};
+
+  uint32_t _magic;
+  uint32_t _version;
+  uint32_t _numEntries;
+  uint32_t _reserved;
+  uint64_t _fileSize_bytes;
+};
+
+struct SpritePackEntry
+{
+  enum Compression { COMPRESSION_NONE, COMPRESSION_RLE };
+
+  static constexpr int maxNameLength {39};
+  static constexpr uint32_t maxDimension_px {1 << 12};     // bounds a decompressed sprite to 64MB.
+
+  char _name[maxNameLength + 1];                             // null terminated.
+  uint32_t _width_px;
+  uint32_t _height_px;
+  uint32_t _compression;
+  uint32_t _reserved;
+  uint64_t _offset_bytes;
+  uint64_t _size_bytes;
+};
+
+struct SpritePackRun
+{
+  uint32_t _count;
+  Color4 _color;
+};
+
+static_assert(sizeof(SpritePackHeader) == 24, "sprite pack header must have no padding");
+static_assert(sizeof(SpritePackEntry) == 72, "sprite pack entry must have no padding");
+static_assert(sizeof(SpritePackRun) == 8, "sprite pack run must have no padding");
+
+constexpr int spritePackAlignment {64};
+
+// Reads sprites from a memory mapped sprite pack. The pack is validated once when opened, after
+// which uncompressed sprites are handed out as views of the mapped pixels.
+class SpritePack
+{
+public:
+  SpritePack() : _file{}, _header{nullptr}, _entries{nullptr}{}
+  ~SpritePack() = default;
+  SpritePack(const SpritePack&) = delete;
+  SpritePack& operator=(const SpritePack&) = delete;
+  int open(const std::string& filename);
+  int getSprite(const std::string& name, Sprite& sprite) const;
+  bool hasSprite(const std::string& name) const {return findEntry(name) != nullptr;}
+  int getNumSprites() const {return _header ? _header->_numEntries : 0;}
+private:
+  const SpritePackEntry* findEntry(const std::string& name) const;
+private:
+  MappedFile _file;
+  const SpritePackHeader* _header;
+  const SpritePackEntry* _entries;
+};
+
+int SpritePack::open(const std::string& filename)
+{
+  _header = nullptr;
+  _entries = nullptr;
+
+  if(!isSystemLittleEndian()){
+    return -1;
+  }
+
+  if(_file.open(filename) != 0){
+    return -1;
+  }
+
+  const uint8_t* bytes = _file.getBytes();
+  uint64_t size = _file.getSize();
+  if(size < sizeof(SpritePackHeader)){
+    return -1;
+  }
+
+  const SpritePackHeader* header = reinterpret_cast<const SpritePackHeader*>(bytes);
+  if(header->_magic != SpritePackHeader::packMagic || header->_version != SpritePackHeader::packVersion ||
+     header->_fileSize_bytes != size){
+    return -1;
+  }
+
+  if(sizeof(SpritePackHeader) + (header->_numEntries * sizeof(SpritePackEntry)) > size){
+    return -1;
+  }
+
+  const SpritePackEntry* entries = reinterpret_cast<const SpritePackEntry*>(bytes + sizeof(SpritePackHeader));
+  for(uint32_t i = 0; i < header->_numEntries; ++i){
+    const SpritePackEntry& entry = entries[i];
+    if(entry._name[SpritePackEntry::maxNameLength] != '\0'){
+      return -1;
+    }
+    if(i > 0 && strcmp(entries[i - 1]._name, entry._name) >= 0){
+      return -1;                                             // unsorted or duplicate names.
+    }
+    if(entry._offset_bytes % spritePackAlignment != 0 || entry._offset_bytes > size || 
+       entry._size_bytes > size - entry._offset_bytes){
+      return -1;
+    }
+    if(entry._width_px > SpritePackEntry::maxDimension_px || 
+       entry._height_px > SpritePackEntry::maxDimension_px){
+      return -1;
+    }
+    uint64_t numPixels = static_cast<uint64_t>(entry._width_px) * entry._height_px;
+    switch(entry._compression)
+    {
+    case SpritePackEntry::COMPRESSION_NONE:
+      if(entry._size_bytes != numPixels * sizeof(Color4))
+        return -1;
+      break;
+    case SpritePackEntry::COMPRESSION_RLE:
+    {
+      if(entry._size_bytes % sizeof(SpritePackRun) != 0)
+        return -1;
+
+      // the runs must cover the sprite exactly, so getSprite never allocates for pixels the
+      // pack does not hold.
+      const SpritePackRun* runs = reinterpret_cast<const SpritePackRun*>(bytes + entry._offset_bytes);
+      uint64_t numRunPixels {0};
+      for(uint64_t j = 0; j < entry._size_bytes / sizeof(SpritePackRun); ++j)
+        numRunPixels += runs[j]._count;
+      if(numRunPixels != numPixels)
+        return -1;
+      break;
+    }
+    default:
+      return -1;
+    }
+  }
+
+  _header = header;
+  _entries = entries;
+  return 0;
+}
+
+// Gets a sprite from the pack; uncompressed sprites are views into the pack, so must not outlive
+// it, compressed sprites are decompressed into sprites which own their pixels.
+int SpritePack::getSprite(const std::string& name, Sprite& sprite) const
+{
+  const SpritePackEntry* entry = findEntry(name);
+  if(entry == nullptr){
+    return -1;
+  }
+
+  const uint8_t* block = _file.getBytes() + entry->_offset_bytes;
+  int width = entry->_width_px;
+  int height = entry->_height_px;
+
+  if(entry->_compression == SpritePackEntry::COMPRESSION_NONE){
+    sprite = Sprite{reinterpret_cast<const Color4*>(block), width, height};
+    return 0;
+  }
+
+  size_t numPixels = static_cast<size_t>(width) * height;
+  std::vector<Color4> pixels(numPixels);
+  const SpritePackRun* runs = reinterpret_cast<const SpritePackRun*>(block);
+  size_t numRuns = entry->_size_bytes / sizeof(SpritePackRun);
+  size_t pixelNo {0};
+  for(size_t i = 0; i < numRuns; ++i){
+    if(runs[i]._count > numPixels - pixelNo){
+      return -1;
+    }
+    std::fill_n(pixels.begin() + pixelNo, runs[i]._count, runs[i]._color);
+    pixelNo += runs[i]._count;
+  }
+  if(pixelNo != numPixels){
+    return -1;
+  }
+
+  sprite = Sprite{std::move(pixels), width, height};
+  return 0;
+}
+
+const SpritePackEntry* SpritePack::findEntry(const std::string& name) const
+{
+  if(_entries == nullptr)
+    return nullptr;
+
+  const SpritePackEntry* end = _entries + _header->_numEntries;
+  const SpritePackEntry* entry = std::lower_bound(_entries, end, name.c_str(), 
+    [](const SpritePackEntry& e, const char* n){return strcmp(e._name, n) < 0;});
+  if(entry == end || strcmp(entry->_name, name.c_str()) != 0)
+    return nullptr;
+  return entry;
+}
+
+std::unique_ptr<SpritePack> spritePack {nullptr};
+
+// Sprites compiled into the binary as constexpr pixel arrays, so they need no file I/O or decode
+// at startup. The arrays are generated from the asset bmps by the skembed tool (make 
+// embeddedAssets.h) and included when building with SK_EMBEDDED_ASSETS; otherwise there are no
+// embedded sprites.
+struct EmbeddedSprite
+{
+  const char* _name;              // the bmp's filename.
+  const Color4* _pixels;
+  int _width_px;
+  int _height_px;
+};
+
+#ifdef SK_EMBEDDED_ASSETS
+#include "embeddedAssets.h"       // defines embeddedSprites.
+#else
+constexpr std::array<EmbeddedSprite, 0> embeddedSprites {};
+#endif
+
+// returns nullptr if there is no embedded sprite with the name.
+const EmbeddedSprite* findEmbeddedSprite(const char* name)
+{
+  for(const auto& sprite : embeddedSprites)
+    if(strcmp(sprite._name, name) == 0)
+      return &sprite;
+  return nullptr;
+}
+
+#endif // SK_SIM_ONLY
+
+//------------------------------------------------------------------------------------------------
+//  SNAKE                                                                                         
+//------------------------------------------------------------------------------------------------
+
+// A grid of one bit per world cell packed row by row into 64-bit words. Single cells are set, 
+// reset and tested in O(1); queries over free (clear) cells scan whole words at a time, skipping 
+// 64 occupied cells per word, which keeps them fast on large (e.g. 1024x1024) worlds.
+//
+// note: the bits past the last cell in the last word are kept set so scans never find them.
+class Bitboard
+{
+public:
+  using Word_t = uint64_t;
+  using Cell_t = uint32_t;
+  static constexpr int bitsPerWord {64};
+  static constexpr Cell_t noCell {std::numeric_limits<Cell_t>::max()};
+public:
+  Bitboard(Vector2i dimensions);
+  ~Bitboard() = default;
+  void set(Cell_t cell);
+  void reset(Cell_t cell);
+  bool test(Cell_t cell) const {return (_words[cell / bitsPerWord] >> (cell % bitsPerWord)) & 1;}
+  void clear();
+  Cell_t findNextClear(Cell_t cell) const;
+  Cell_t findNthClear(uint32_t n) const;
+  uint32_t getNumCells() const {return _numCells;}
+  uint32_t getNumSet() const {return _numSet;}
+  uint32_t getNumClear() const {return _numCells - _numSet;}
+  const std::vector<Word_t>& getWords() const {return _words;}
+private:
+  std::vector<Word_t> _words;
+  uint32_t _numCells;
+  uint32_t _numSet;
+};
+
+Bitboard::Bitboard(Vector2i dimensions) :
+  _words{},
+  _numCells{static_cast<uint32_t>(dimensions._x * dimensions._y)},
+  _numSet{0}
+{
+  _words.resize((_numCells + bitsPerWord - 1) / bitsPerWord);
+  clear();
+}
+
+void Bitboard::set(Cell_t cell)
+{
+  assert(cell < _numCells);
+  Word_t bit = Word_t{1} << (cell % bitsPerWord);
+  Word_t& word = _words[cell / bitsPerWord];
+  _numSet += (word & bit) ? 0 : 1;
+  word |= bit;
+}
+
+void Bitboard::reset(Cell_t cell)
+{
+  assert(cell < _numCells);
+  Word_t bit = Word_t{1} << (cell % bitsPerWord);
+  Word_t& word = _words[cell / bitsPerWord];
+  _numSet -= (word & bit) ? 1 : 0;
+  word &= ~bit;
+}
+
+void Bitboard::clear()
+{
+  std::fill(_words.begin(), _words.end(), Word_t{0});
+  int numPadBits = (_words.size() * bitsPerWord) - _numCells;
+  if(numPadBits > 0)
+    _words.back() = ~Word_t{0} << (bitsPerWord - numPadBits);
+  _numSet = 0;
+}
+
+// Finds the first clear cell at or after a cell, wrapping around to the first cell; returns 
+// noCell if all cells are set.
+Bitboard::Cell_t Bitboard::findNextClear(Cell_t cell) const
+{
+  assert(cell < _numCells);
+  size_t numWords = _words.size();
+  size_t wordNo = cell / bitsPerWord;
+
+  // the first word is scanned twice: from the cell on, then (after wrapping) up to the cell.
+  Word_t clearBits = ~_words[wordNo] & (~Word_t{0} << (cell % bitsPerWord));
+  for(size_t i = 0; i <= numWords; ++i){
+    if(clearBits != 0)
+      return (wordNo * bitsPerWord) + __builtin_ctzll(clearBits);
+    wordNo = (wordNo + 1 == numWords) ? 0 : wordNo + 1;
+    clearBits = ~_words[wordNo];
+  }
+  return noCell;
+}
+
+// Finds the nth (from 0) clear cell in cell order, e.g. to pick a uniformly random free cell; 
+// whole words are skipped by counting their clear bits. Returns noCell if n >= getNumClear().
+Bitboard::Cell_t Bitboard::findNthClear(uint32_t n) const
+{
+  for(size_t wordNo = 0; wordNo < _words.size(); ++wordNo){
+    Word_t clearBits = ~_words[wordNo];
+    uint32_t numClear = __builtin_popcountll(clearBits);
+    if(n >= numClear){
+      n -= numClear;
+      continue;
+    }
+    for(; n > 0; --n)
+      clearBits &= clearBits - 1;     // clears the lowest set bit.
+    return (wordNo * bitsPerWord) + __builtin_ctzll(clearBits);
+  }
+  return noCell;
+}
+
+// The snake's body is a ring buffer of the cells it occupies, ordered from tail to head. A move
+// pushes the cell the head moves into and pops the cell the tail leaves; growing simply skips 
+// the pop. Thus a move costs the same for a snake of any length (no segments are shifted).
+//
+// Cells are packed into a single index (row * world width + col), so each segment is one word.
+// The capacity of the ring is the number of cells in the world rounded up to a power of 2 (so
+// indices wrap with a mask), which is as long as a snake can ever grow.
+//
+// The cells the snake occupies are also marked on an occupancy bitboard which is updated as the
+// head enters and the tail leaves cells, so collisions are tested in O(1) rather than by 
+// scanning the body.
+//
+// Each segment has a type (used to select its sprite) which depends on the directions to its 
+// neighbours. Along with its cell, each segment records the direction the head moved to enter 
+// it, which is the direction from the segment behind it; a move thus changes the types of only
+// the new head, the old head (now the neck) and the new tail, which are looked up in a table of
+// types by (direction to head, direction to tail).
+//
+// note: directions are w.r.t the world's rows and cols; north is toward increasing rows.
+class Snake
+{
+public:
+  enum MoveDirection : uint8_t { NORTH, SOUTH, EAST, WEST };
+
+  // body and corner types are named by the directions from their tail to their head side.
+  enum SegmentType : uint8_t { 
+    BODY_EW, BODY_WE, BODY_NS, BODY_SN, CORNER_EN, CORNER_NE, CORNER_WN, CORNER_NW, CORNER_ES, 
+    CORNER_SE, CORNER_WS, CORNER_SW, HEAD_E, HEAD_W, HEAD_N, HEAD_S, TAIL_E, TAIL_W, TAIL_N, 
+    TAIL_S, SEGMENT_TYPE_COUNT
+  };
+
+  using Cell_t = Bitboard::Cell_t;
+public:
+  Snake(Vector2i worldDimensions, Vector2i headPosition, MoveDirection direction, int length);
+  ~Snake() = default;
+  void move();
+  void grow(int numSegments) {_growth += numSegments;}
+  void setMoveDirection(MoveDirection direction);
+  MoveDirection getMoveDirection() const {return _nextDirection;}
+  bool isMoveBlocked() const {return isMoveBlocked(_nextDirection);}
+  bool isMoveBlocked(MoveDirection direction) const;
+  bool isOccupied(Cell_t cell) const {return _occupancy.test(cell);}
+  const Bitboard& getOccupancy() const {return _occupancy;}
+  Cell_t getNextHeadCell() const {return getNextHeadCell(_nextDirection);}
+  Cell_t getNextHeadCell(MoveDirection direction) const;
+  Cell_t stepCell(Cell_t cell, MoveDirection direction) const;
+  Vector2i getHeadPosition() const {return _headPosition;}
+  Cell_t getCell(int segmentNo) const {return _cells[getRingNo(segmentNo)];}
+  SegmentType getSegmentType(int segmentNo) const {return _types[getRingNo(segmentNo)];}
+  Cell_t getHeadCell() const {return _cells[_headNo];}
+  Cell_t getTailCell() const {return getCell(_length - 1);}
+  int getLength() const {return _length;}
+  int getGrowth() const {return _growth;}
+  Vector2i getWorldDimensions() const {return _worldDimensions;}
+  Vector2i toPosition(Cell_t cell) const;
+  Cell_t toCell(Vector2i position) const;
+private:
+  static constexpr std::array<MoveDirection, 4> reverseDirections {SOUTH, NORTH, WEST, EAST};
+  static constexpr std::array<SegmentType, 4> headTypes {HEAD_N, HEAD_S, HEAD_E, HEAD_W};
+  static constexpr std::array<SegmentType, 4> tailTypes {TAIL_N, TAIL_S, TAIL_E, TAIL_W};
+
+  // indexed [direction to head][direction to tail]; a segment's neighbours can only be in the 
+  // same direction on worlds 2 cells across, which are given straight types.
+  static constexpr std::array<std::array<SegmentType, 4>, 4> bodyTypes {{
+    {BODY_SN, BODY_SN, CORNER_EN, CORNER_WN},   // head NORTH; tail NORTH, SOUTH, EAST, WEST.
+    {BODY_NS, BODY_NS, CORNER_ES, CORNER_WS},   // head SOUTH.
+    {CORNER_NE, CORNER_SE, BODY_WE, BODY_WE},   // head EAST.
+    {CORNER_NW, CORNER_SW, BODY_EW, BODY_EW}    // head WEST.
+  }};
+private:
+  Vector2i stepPosition(Vector2i position, MoveDirection direction) const;
+  uint32_t getRingNo(int segmentNo) const {return (_headNo - segmentNo) & _capacityMask;}
+private:
+  Bitboard _occupancy;
+
+  // ring buffers; segment n is n segments behind the head in all.
+  std::vector<Cell_t> _cells;
+  std::vector<MoveDirection> _directions;   // direction the head moved to enter the segment.
+  std::vector<SegmentType> _types;
+
+  uint32_t _capacityMask;
+  uint32_t _headNo;                   // ring index of the head.
+  int _length;                        // unit: segments.
+  int _growth;                        // segments still to grow; the tail stays put until 0.
+  Vector2i _worldDimensions;          // [x:width(num cols), y:height(num rows)]
+  Vector2i _headPosition;             // [x:col, y:row] kept to wrap without dividing the cell.
+  MoveDirection _direction;           // direction of the last move.
+  MoveDirection _nextDirection;       // direction of the next move.
+};
+
+// The snake starts in a straight line trailing away from its direction of movement, wrapping 
+// around the world if it is longer than the distance to the world's edge (but it must not wrap
+// onto itself).
+Snake::Snake(Vector2i worldDimensions, Vector2i headPosition, MoveDirection direction, int length) :
+  _occupancy{worldDimensions},
+  _cells{},
+  _directions{},
+  _types{},
+  _capacityMask{0},
+  _headNo{0},
+  _length{1},
+  _growth{0},
+  _worldDimensions{worldDimensions},
+  _headPosition{headPosition},
+  _direction{direction},
+  _nextDirection{direction}
+{
+  assert(worldDimensions._x > 0 && worldDimensions._y > 0);
+  assert(0 < length);
+  assert(length <= ((direction == NORTH || direction == SOUTH) ? worldDimensions._y : worldDimensions._x));
+
+  uint32_t numCells = worldDimensions._x * worldDimensions._y;
+  uint32_t capacity = 1;
+  while(capacity < numCells)
+    capacity <<= 1;
+  _cells.resize(capacity);
+  _directions.resize(capacity);
+  _types.resize(capacity);
+  _capacityMask = capacity - 1;
+
+  // lays out the body from the head back to the tail.
+  _headNo = length - 1;
+  _length = length;
+  Vector2i position = headPosition;
+  for(int i = 0; i < length; ++i){
+    _cells[_headNo - i] = toCell(position);
+    _directions[_headNo - i] = direction;
+    _types[_headNo - i] = bodyTypes[direction][reverseDirections[direction]];
+    _occupancy.set(_cells[_headNo - i]);
+    position = stepPosition(position, reverseDirections[direction]);
+  }
+  _types[0] = tailTypes[direction];
+  _types[_headNo] = headTypes[direction];
+}
+
+// Moves the head one cell in the move direction, wrapping around the edges of the world; the
+// tail follows unless the snake is growing.
+//
+// note: the move must not be blocked (see isMoveBlocked); a snake cannot move into itself.
+void Snake::move()
+{
+  assert(!isMoveBlocked());
+  if(_growth > 0){
+    ++_length;
+    --_growth;
+  }
+  else
+    _occupancy.reset(getTailCell());    // the tail leaves before the head enters.
+  _headPosition = stepPosition(_headPosition, _nextDirection);
+  _headNo = (_headNo + 1) & _capacityMask;
+  _cells[_headNo] = toCell(_headPosition);
+  _directions[_headNo] = _nextDirection;
+  _occupancy.set(_cells[_headNo]);
+  _direction = _nextDirection;
+
+  // only the neck, tail and head change type; the latter take precedence on short snakes.
+  if(_length > 1){
+    uint32_t neckNo = getRingNo(1);
+    _types[neckNo] = bodyTypes[_direction][reverseDirections[_directions[neckNo]]];
+    _types[getRingNo(_length - 1)] = tailTypes[_directions[getRingNo(_length - 2)]];
+  }
+  _types[_headNo] = headTypes[_direction];
+}
+
+// Tests if a move in a direction would run the head into the body. The head may follow into the
+// cell of the tail as the tail leaves it, unless the snake is growing (the tail stays put).
+bool Snake::isMoveBlocked(MoveDirection direction) const
+{
+  Cell_t nextHeadCell = getNextHeadCell(direction);
+  if(!_occupancy.test(nextHeadCell))
+    return false;
+  return nextHeadCell != getTailCell() || _growth > 0;
+}
+
+// The snake cannot reverse into its own neck, so reversals are ignored.
+void Snake::setMoveDirection(MoveDirection direction)
+{
+  if(_length > 1 && direction == reverseDirections[_direction])
+    return;
+  _nextDirection = direction;
+}
+
+Snake::Cell_t Snake::getNextHeadCell(MoveDirection direction) const
+{
+  return toCell(stepPosition(_headPosition, direction));
+}
+
+// As stepPosition, but on cells; for players which search ahead of the snake.
+Snake::Cell_t Snake::stepCell(Cell_t cell, MoveDirection direction) const
+{
+  uint32_t width = _worldDimensions._x;
+  uint32_t numCells = _occupancy.getNumCells();
+  uint32_t x = cell % width;
+  switch(direction)
+  {
+  case NORTH:
+    return (cell + width >= numCells) ? x : cell + width;
+  case SOUTH:
+    return (cell < width) ? cell + numCells - width : cell - width;
+  case EAST:
+    return (x == width - 1) ? cell - x : cell + 1;
+  case WEST:
+    return (x == 0) ? cell + width - 1 : cell - 1;
+  }
+  return cell;
+}
+
+// Steps one cell from a position, wrapping around the edges of the world.
+Vector2i Snake::stepPosition(Vector2i position, MoveDirection direction) const
+{
+  switch(direction)
+  {
+  case NORTH:
+    position._y = (position._y == _worldDimensions._y - 1) ? 0 : position._y + 1;
+    break;
+  case SOUTH:
+    position._y = (position._y == 0) ? _worldDimensions._y - 1 : position._y - 1;
+    break;
+  case EAST:
+    position._x = (position._x == _worldDimensions._x - 1) ? 0 : position._x + 1;
+    break;
+  case WEST:
+    position._x = (position._x == 0) ? _worldDimensions._x - 1 : position._x - 1;
+    break;
+  }
+  return position;
+}
+
+Vector2i Snake::toPosition(Cell_t cell) const
+{
+  return Vector2i{static_cast<int32_t>(cell % _worldDimensions._x), 
+                  static_cast<int32_t>(cell / _worldDimensions._x)};
+}
+
+Snake::Cell_t Snake::toCell(Vector2i position) const
+{
+  return (position._y * _worldDimensions._x) + position._x;
+}
+
+// The rules of the game without any input, timing or drawing: each step the snake moves one 
+// cell, eating the food scores and grows the snake (and places new food) and the game is over
+// when the snake runs into itself, or won when it fills the world. Games are seeded so they can
+// be replayed.
+//
+// note: the simulation depends only on the standard library so it can be built without SDL or
+// opengl (see SK_SIM_ONLY) and run headless many games at a time (see skbatch.cpp).
+class Simulation
+{
+public:
+  enum State { STATE_PLAYING, STATE_DEAD, STATE_WON };
+  struct Config
+  {
+    Vector2i _worldDimensions;    // [x:width(num cols), y:height(num rows)]
+    int _snakeStartLength;        // unit: segments.
+    int _growthPerFood;           // unit: segments.
+  };
+public:
+  Simulation(const Config& config, uint32_t seed);
+  ~Simulation() = default;
+  void restart();
+  State step();
+  void setMoveDirection(Snake::MoveDirection direction) {_snake.setMoveDirection(direction);}
+  const Snake& getSnake() const {return _snake;}
+  Snake::Cell_t getFoodCell() const {return _foodCell;}
+  State getState() const {return _state;}
+  int getScore() const {return _score;}
+  int64_t getNumSteps() const {return _numSteps;}
+  const Config& getConfig() const {return _config;}
+private:
+  Snake makeSnake() const;
+  void placeFood();
+private:
+  Config _config;
+  std::mt19937 _rng;
+  Snake _snake;
+  Snake::Cell_t _foodCell;
+  State _state;
+  int _score;
+  int64_t _numSteps;
+};
+
+Simulation::Simulation(const Config& config, uint32_t seed) :
+  _config{config},
+  _rng{seed},
+  _snake{makeSnake()},
+  _foodCell{Bitboard::noCell},
+  _state{STATE_PLAYING},
+  _score{0},
+  _numSteps{0}
+{
+  placeFood();
+}
+
+// Starts a new game; the random sequence continues from the last game rather than repeating.
+void Simulation::restart()
+{
+  _snake = makeSnake();
+  _state = STATE_PLAYING;
+  _score = 0;
+  _numSteps = 0;
+  placeFood();
+}
+
+// Moves the snake one cell; does nothing once the game is over.
+Simulation::State Simulation::step()
+{
+  if(_state != STATE_PLAYING)
+    return _state;
+  if(_snake.isMoveBlocked()){
+    _state = STATE_DEAD;
+    return _state;
+  }
+  _snake.move();
+  ++_numSteps;
+  if(_snake.getHeadCell() == _foodCell){
+    ++_score;
+    _snake.grow(_config._growthPerFood);
+    placeFood();
+    if(_foodCell == Bitboard::noCell)
+      _state = STATE_WON;
+  }
+  return _state;
+}
+
+// The snake starts in the middle of the world heading east.
+Snake Simulation::makeSnake() const
+{
+  Vector2i dimensions = _config._worldDimensions;
+  return Snake{dimensions, Vector2i{dimensions._x / 2, dimensions._y / 2}, Snake::EAST, 
+               _config._snakeStartLength};
+}
+
+// Places the food in a uniformly random free cell; if the snake fills the world there is 
+// nowhere left to place it.
+void Simulation::placeFood()
+{
+  const Bitboard& occupancy = _snake.getOccupancy();
+  if(occupancy.getNumClear() == 0){
+    _foodCell = Bitboard::noCell;
+    return;
+  }
+  std::uniform_int_distribution<uint32_t> distribution {0, occupancy.getNumClear() - 1};
+  _foodCell = occupancy.findNthClear(distribution(_rng));
+}
+
+// Advances many games in lockstep with their state laid out structure-of-arrays (element n of
+// each array is game n), so the part of a step which is the same for every game - moving the 
+// heads, wrapping them around the world and testing the cells they move into for collisions and
+// food - runs over 8 games at a time with AVX2. The rest of a step (the ring buffers, bitboards 
+// and food placement) touches memory private to each game and stays scalar, but is only a few 
+// loads and stores per game.
+//
+// The rules are those of Simulation: a game seeded the same and given the same moves plays out
+// exactly as it does in a Simulation. Segment types are not kept since the games are not drawn.
+// Games which are over (or stopped) are skipped by step until they are restarted.
+//
+// Players (e.g. bots or learning agents) which need to know which moves are blocked in every 
+// game can have them found for all games at once with updateBlockedMoves, which uses the same 
+// vectorized collision test as step.
+//
+// note: lanes are padded to a multiple of laneGroupSize; the padding lanes are never played.
+class WideSimulation
+{
+public:
+  static constexpr int laneGroupSize {8};
+public:
+  WideSimulation(const Simulation::Config& config, int numGames, uint32_t seed);
+  ~WideSimulation() = default;
+  void restart(int gameNo, uint32_t seed);
+  void stop(int gameNo) {_states[gameNo] = Simulation::STATE_DEAD;}
+  void step();
+  void setMoveDirection(int gameNo, Snake::MoveDirection direction);
+  bool isMoveBlocked(int gameNo, Snake::MoveDirection direction) const;
+  void updateBlockedMoves();
+  int getBlockedMoves(int gameNo) const {return _blockedMoves[gameNo];}
+  int getNumGames() const {return _numGames;}
+  Vector2i getWorldDimensions() const {return _config._worldDimensions;}
+  Simulation::State getState(int gameNo) const {return static_cast<Simulation::State>(_states[gameNo]);}
+  Snake::MoveDirection getMoveDirection(int gameNo) const {return static_cast<Snake::MoveDirection>(_directions[gameNo]);}
+  Vector2i getHeadPosition(int gameNo) const {return Vector2i{_headXs[gameNo], _headYs[gameNo]};}
+  Snake::Cell_t getFoodCell(int gameNo) const {return _foodCells[gameNo];}
+  int getLength(int gameNo) const {return _lengths[gameNo];}
+  int getScore(int gameNo) const {return _scores[gameNo];}
+  int64_t getNumSteps(int gameNo) const {return _numSteps[gameNo];}
+  Vector2i toPosition(Snake::Cell_t cell) const;
+private:
+  using Word_t = uint32_t;                // 32-bit words so lanes can gather their own words.
+  static constexpr int bitsPerWord {32};
+
+  // move deltas indexed by Snake::MoveDirection.
+  static constexpr std::array<int32_t, 4> deltaXs {0, 0, 1, -1};
+  static constexpr std::array<int32_t, 4> deltaYs {1, -1, 0, 0};
+private:
+  void stepKernel();
+  void blockedMovesKernel();
+#if defined(__x86_64__) || defined(__i386__)
+  void stepKernelAvx2();
+  void blockedMovesKernelAvx2();
+#endif
+  void placeFood(int gameNo);
+  Snake::Cell_t findNthClear(int gameNo, uint32_t n) const;
+  Snake::Cell_t toCell(int32_t x, int32_t y) const {return (y * _config._worldDimensions._x) + x;}
+  Snake::Cell_t* getRing(int gameNo) {return _rings.data() + (static_cast<size_t>(gameNo) << _ringShift);}
+  Word_t* getBoard(int gameNo) {return _boards.data() + (static_cast<size_t>(gameNo) * _wordsPerBoard);}
+  const Word_t* getBoard(int gameNo) const {return _boards.data() + (static_cast<size_t>(gameNo) * _wordsPerBoard);}
+  bool testCell(int gameNo, Snake::Cell_t cell) const;
+private:
+  Simulation::Config _config;
+  int _numGames;
+  int _numLanes;                          // num games rounded up to a multiple of laneGroupSize.
+  uint32_t _numCells;
+  int _ringShift;                         // log2 of each game's ring capacity.
+  uint32_t _ringMask;
+  int _wordsPerBoard;
+  bool _isAvx2;
+
+  std::vector<int32_t> _headXs;
+  std::vector<int32_t> _headYs;
+  std::vector<int32_t> _directions;       // direction of the next move.
+  std::vector<int32_t> _lastDirections;   // direction of the last move.
+  std::vector<int32_t> _lengths;
+  std::vector<int32_t> _growths;
+  std::vector<uint32_t> _headNos;         // ring index of the head.
+  std::vector<Snake::Cell_t> _tailCells;
+  std::vector<Snake::Cell_t> _foodCells;
+  std::vector<int32_t> _states;
+  std::vector<int32_t> _scores;
+  std::vector<int64_t> _numSteps;
+  std::vector<std::mt19937> _rngs;
+
+  // outputs of the step kernels; the flags are 0 or ~0 (vector compare results).
+  std::vector<int32_t> _nextXs;
+  std::vector<int32_t> _nextYs;
+  std::vector<Snake::Cell_t> _nextCells;
+  std::vector<int32_t> _isBlocked;
+  std::vector<int32_t> _isEating;
+
+  // output of the blocked moves kernels; bit n is set if a move in direction n is blocked.
+  std::vector<int32_t> _blockedMoves;
+
+  // each game's ring buffer of cells (as in Snake) and occupancy bitboard, stored back to back.
+  std::vector<Snake::Cell_t> _rings;
+  std::vector<Word_t> _boards;
+};
+
+WideSimulation::WideSimulation(const Simulation::Config& config, int numGames, uint32_t seed) :
+  _config{config},
+  _numGames{numGames},
+  _numLanes{((numGames + laneGroupSize - 1) / laneGroupSize) * laneGroupSize},
+  _numCells{static_cast<uint32_t>(config._worldDimensions._x * config._worldDimensions._y)},
+  _ringShift{0},
+  _ringMask{0},
+  _wordsPerBoard{0},
+  _isAvx2{std::min(detectSimdLevel(), maxSimdLevel) == SIMD_AVX2}
+{
+  assert(numGames > 0);
+  while((uint32_t{1} << _ringShift) < _numCells)
+    ++_ringShift;
+  _ringMask = (uint32_t{1} << _ringShift) - 1;
+  _wordsPerBoard = (_numCells + bitsPerWord - 1) / bitsPerWord;
+
+  // gather indices are 32-bit.
+  assert(static_cast<int64_t>(_numLanes) * _wordsPerBoard <= std::numeric_limits<int32_t>::max());
+
+  for(auto* lanes : {&_headXs, &_headYs, &_directions, &_lastDirections, &_lengths, &_growths, 
+                     &_states, &_scores, &_nextXs, &_nextYs, &_isBlocked, &_isEating, 
+                     &_blockedMoves})
+    lanes->resize(_numLanes, 0);
+  for(auto* lanes : {&_headNos, &_tailCells, &_foodCells, &_nextCells})
+    lanes->resize(_numLanes, 0);
+  _numSteps.resize(_numLanes, 0);
+  _rngs.resize(_numLanes);
+  _rings.resize(static_cast<size_t>(_numLanes) << _ringShift);
+  _boards.resize(static_cast<size_t>(_numLanes) * _wordsPerBoard);
+
+  for(int gameNo = 0; gameNo < _numLanes; ++gameNo)
+    restart(gameNo, seed + gameNo);
+  for(int gameNo = _numGames; gameNo < _numLanes; ++gameNo)
+    _states[gameNo] = Simulation::STATE_DEAD;
+}
+
+// Starts a new game in a lane; the snake starts as in Simulation, in the middle of the world
+// heading east.
+void WideSimulation::restart(int gameNo, uint32_t seed)
+{
+  Vector2i dimensions = _config._worldDimensions;
+  int length = _config._snakeStartLength;
+  assert(0 < length && length <= dimensions._x);
+
+  Word_t* board = getBoard(gameNo);
+  std::fill_n(board, _wordsPerBoard, Word_t{0});
+  int numPadBits = (_wordsPerBoard * bitsPerWord) - _numCells;
+  if(numPadBits > 0)
+    board[_wordsPerBoard - 1] = ~Word_t{0} << (bitsPerWord - numPadBits);
+
+  Snake::Cell_t* ring = getRing(gameNo);
+  int32_t x = dimensions._x / 2;
+  int32_t y = dimensions._y / 2;
+  _headXs[gameNo] = x;
+  _headYs[gameNo] = y;
+  for(int i = length - 1; i >= 0; --i){
+    Snake::Cell_t cell = toCell(x, y);
+    ring[i] = cell;
+    board[cell / bitsPerWord] |= Word_t{1} << (cell % bitsPerWord);
+    x = (x == 0) ? dimensions._x - 1 : x - 1;
+  }
+  _headNos[gameNo] = length - 1;
+  _tailCells[gameNo] = ring[0];
+  _directions[gameNo] = Snake::EAST;
+  _lastDirections[gameNo] = Snake::EAST;
+  _lengths[gameNo] = length;
+  _growths[gameNo] = 0;
+  _states[gameNo] = Simulation::STATE_PLAYING;
+  _scores[gameNo] = 0;
+  _numSteps[gameNo] = 0;
+  _rngs[gameNo].seed(seed);
+  placeFood(gameNo);
+}
+
+// Snakes cannot reverse into their own neck, so reversals are ignored.
+void WideSimulation::setMoveDirection(int gameNo, Snake::MoveDirection direction)
+{
+  static constexpr std::array<int32_t, 4> reverseDirections {
+    Snake::SOUTH, Snake::NORTH, Snake::WEST, Snake::EAST
+  };
+  if(_lengths[gameNo] > 1 && direction == reverseDirections[_lastDirections[gameNo]])
+    return;
+  _directions[gameNo] = direction;
+}
+
+// As Snake::isMoveBlocked.
+bool WideSimulation::isMoveBlocked(int gameNo, Snake::MoveDirection direction) const
+{
+  Vector2i dimensions = _config._worldDimensions;
+  int32_t x = _headXs[gameNo] + deltaXs[direction];
+  int32_t y = _headYs[gameNo] + deltaYs[direction];
+  x = (x < 0) ? dimensions._x - 1 : (x == dimensions._x) ? 0 : x;
+  y = (y < 0) ? dimensions._y - 1 : (y == dimensions._y) ? 0 : y;
+  Snake::Cell_t cell = toCell(x, y);
+  if(!testCell(gameNo, cell))
+    return false;
+  return cell != _tailCells[gameNo] || _growths[gameNo] > 0;
+}
+
+// Steps all games which are playing. The kernel finds where each head moves to and what it 
+// hits; each game's body, bitboard and food are then updated from the kernel's outputs.
+void WideSimulation::step()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(_isAvx2)
+    stepKernelAvx2();
+  else
+    stepKernel();
+#else
+  stepKernel();
+#endif
+
+  for(int gameNo = 0; gameNo < _numGames; ++gameNo){
+    if(_states[gameNo] != Simulation::STATE_PLAYING)
+      continue;
+    if(_isBlocked[gameNo]){
+      _states[gameNo] = Simulation::STATE_DEAD;
+      continue;
+    }
+
+    Snake::Cell_t* ring = getRing(gameNo);
+    Word_t* board = getBoard(gameNo);
+    uint32_t headNo = _headNos[gameNo];
+    int length = _lengths[gameNo];
+    if(_growths[gameNo] > 0){
+      ++length;
+      --_growths[gameNo];
+    }
+    else{
+      Snake::Cell_t tail = _tailCells[gameNo];
+      board[tail / bitsPerWord] &= ~(Word_t{1} << (tail % bitsPerWord));
+    }
+    headNo = (headNo + 1) & _ringMask;
+    Snake::Cell_t head = _nextCells[gameNo];
+    ring[headNo] = head;
+    board[head / bitsPerWord] |= Word_t{1} << (head % bitsPerWord);
+
+    _headNos[gameNo] = headNo;
+    _lengths[gameNo] = length;
+    _tailCells[gameNo] = ring[(headNo - (length - 1)) & _ringMask];
+    _headXs[gameNo] = _nextXs[gameNo];
+    _headYs[gameNo] = _nextYs[gameNo];
+    _lastDirections[gameNo] = _directions[gameNo];
+    ++_numSteps[gameNo];
+
+    if(_isEating[gameNo]){
+      ++_scores[gameNo];
+      _growths[gameNo] += _config._growthPerFood;
+      placeFood(gameNo);
+      if(_foodCells[gameNo] == Bitboard::noCell)
+        _states[gameNo] = Simulation::STATE_WON;
+    }
+  }
+}
+
+// Finds the moves which are blocked in all games; bit n of getBlockedMoves is set if a move in 
+// direction n (Snake::MoveDirection) is blocked. Moves are those before the next step.
+void WideSimulation::updateBlockedMoves()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  if(_isAvx2)
+    blockedMovesKernelAvx2();
+  else
+    blockedMovesKernel();
+#else
+  blockedMovesKernel();
+#endif
+}
+
+void WideSimulation::blockedMovesKernel()
+{
+  for(int gameNo = 0; gameNo < _numLanes; ++gameNo){
+    int32_t blockedMoves {0};
+    for(auto direction : {Snake::NORTH, Snake::SOUTH, Snake::EAST, Snake::WEST})
+      blockedMoves |= isMoveBlocked(gameNo, direction) ? (1 << direction) : 0;
+    _blockedMoves[gameNo] = blockedMoves;
+  }
+}
+
+void WideSimulation::stepKernel()
+{
+  int32_t width = _config._worldDimensions._x;
+  int32_t height = _config._worldDimensions._y;
+  for(int gameNo = 0; gameNo < _numLanes; ++gameNo){
+    int32_t x = _headXs[gameNo] + deltaXs[_directions[gameNo]];
+    int32_t y = _headYs[gameNo] + deltaYs[_directions[gameNo]];
+    x = (x < 0) ? width - 1 : (x == width) ? 0 : x;
+    y = (y < 0) ? height - 1 : (y == height) ? 0 : y;
+    Snake::Cell_t cell = toCell(x, y);
+    bool isTailFollow = (cell == _tailCells[gameNo]) && (_growths[gameNo] == 0);
+    _nextXs[gameNo] = x;
+    _nextYs[gameNo] = y;
+    _nextCells[gameNo] = cell;
+    _isBlocked[gameNo] = (testCell(gameNo, cell) && !isTailFollow) ? ~0 : 0;
+    _isEating[gameNo] = (cell == _foodCells[gameNo]) ? ~0 : 0;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("avx2")))
+static inline __m256i loadLanes(const void* lanes)
+{
+  return _mm256_loadu_si256(static_cast<const __m256i*>(lanes));
+}
+
+__attribute__((target("avx2")))
+static inline void storeLanes(void* lanes, __m256i values)
+{
+  _mm256_storeu_si256(static_cast<__m256i*>(lanes), values);
+}
+
+// Wraps -1 to size - 1 and size to 0.
+__attribute__((target("avx2")))
+static inline __m256i wrapLanes(__m256i v, __m256i size)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  v = _mm256_blendv_epi8(v, _mm256_add_epi32(v, size), _mm256_cmpgt_epi32(zero, v));
+  return _mm256_blendv_epi8(v, zero, _mm256_cmpeq_epi32(v, size));
+}
+
+// The scalar kernels on 8 lanes at once; the occupancy bit of each lane's next cell is found by
+// gathering the bitboard word of each lane (at lane * words per board + cell / 32).
+__attribute__((target("avx2")))
+void WideSimulation::stepKernelAvx2()
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i width = _mm256_set1_epi32(_config._worldDimensions._x);
+  const __m256i height = _mm256_set1_epi32(_config._worldDimensions._y);
+  const __m256i deltaX = _mm256_setr_epi32(deltaXs[0], deltaXs[1], deltaXs[2], deltaXs[3], 0, 0, 0, 0);
+  const __m256i deltaY = _mm256_setr_epi32(deltaYs[0], deltaYs[1], deltaYs[2], deltaYs[3], 0, 0, 0, 0);
+  const __m256i bitNoMask = _mm256_set1_epi32(bitsPerWord - 1);
+  const __m256i laneWordNos = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), 
+                                                 _mm256_set1_epi32(_wordsPerBoard));
+  const int* boards = reinterpret_cast<const int*>(_boards.data());
+
+  for(int gameNo = 0; gameNo < _numLanes; gameNo += laneGroupSize){
+    __m256i directions = loadLanes(&_directions[gameNo]);
+    __m256i x = _mm256_add_epi32(loadLanes(&_headXs[gameNo]), _mm256_permutevar8x32_epi32(deltaX, directions));
+    __m256i y = _mm256_add_epi32(loadLanes(&_headYs[gameNo]), _mm256_permutevar8x32_epi32(deltaY, directions));
+    x = wrapLanes(x, width);
+    y = wrapLanes(y, height);
+    __m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(y, width), x);
+
+    __m256i wordNos = _mm256_add_epi32(_mm256_set1_epi32(gameNo * _wordsPerBoard), laneWordNos);
+    wordNos = _mm256_add_epi32(wordNos, _mm256_srli_epi32(cell, 5));
+    __m256i words = _mm256_i32gather_epi32(boards, wordNos, 4);
+    __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(cell, bitNoMask)), one);
+    __m256i isOccupied = _mm256_cmpeq_epi32(bits, one);
+
+    __m256i isTailFollow = _mm256_and_si256(_mm256_cmpeq_epi32(cell, loadLanes(&_tailCells[gameNo])),
+                                            _mm256_cmpeq_epi32(loadLanes(&_growths[gameNo]), zero));
+    storeLanes(&_nextXs[gameNo], x);
+    storeLanes(&_nextYs[gameNo], y);
+    storeLanes(&_nextCells[gameNo], cell);
+    storeLanes(&_isBlocked[gameNo], _mm256_andnot_si256(isTailFollow, isOccupied));
+    storeLanes(&_isEating[gameNo], _mm256_cmpeq_epi32(cell, loadLanes(&_foodCells[gameNo])));
+  }
+}
+
+// note: moves are tested a direction at a time, so the 4 moves of a lane are 4 gathers.
+__attribute__((target("avx2")))
+void WideSimulation::blockedMovesKernelAvx2()
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i width = _mm256_set1_epi32(_config._worldDimensions._x);
+  const __m256i height = _mm256_set1_epi32(_config._worldDimensions._y);
+  const __m256i bitNoMask = _mm256_set1_epi32(bitsPerWord - 1);
+  const __m256i laneWordNos = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), 
+                                                 _mm256_set1_epi32(_wordsPerBoard));
+  const int* boards = reinterpret_cast<const int*>(_boards.data());
+
+  for(int gameNo = 0; gameNo < _numLanes; gameNo += laneGroupSize){
+    __m256i headX = loadLanes(&_headXs[gameNo]);
+    __m256i headY = loadLanes(&_headYs[gameNo]);
+    __m256i tailCell = loadLanes(&_tailCells[gameNo]);
+    __m256i isNotGrowing = _mm256_cmpeq_epi32(loadLanes(&_growths[gameNo]), zero);
+    __m256i gameWordNos = _mm256_add_epi32(_mm256_set1_epi32(gameNo * _wordsPerBoard), laneWordNos);
+    __m256i blockedMoves = zero;
+    for(int direction = 0; direction < 4; ++direction){
+      __m256i x = wrapLanes(_mm256_add_epi32(headX, _mm256_set1_epi32(deltaXs[direction])), width);
+      __m256i y = wrapLanes(_mm256_add_epi32(headY, _mm256_set1_epi32(deltaYs[direction])), height);
+      __m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(y, width), x);
+      __m256i wordNos = _mm256_add_epi32(gameWordNos, _mm256_srli_epi32(cell, 5));
+      __m256i words = _mm256_i32gather_epi32(boards, wordNos, 4);
+      __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(cell, bitNoMask)), one);
+      __m256i isTailFollow = _mm256_and_si256(_mm256_cmpeq_epi32(cell, tailCell), isNotGrowing);
+      bits = _mm256_andnot_si256(isTailFollow, bits);
+      blockedMoves = _mm256_or_si256(blockedMoves, _mm256_slli_epi32(bits, direction));
+    }
+    storeLanes(&_blockedMoves[gameNo], blockedMoves);
+  }
+}
+
+#endif
+
+bool WideSimulation::testCell(int gameNo, Snake::Cell_t cell) const
+{
+  return (getBoard(gameNo)[cell / bitsPerWord] >> (cell % bitsPerWord)) & 1;
+}
+
+// As Simulation::placeFood, so games place the same food as they would in a Simulation.
+void WideSimulation::placeFood(int gameNo)
+{
+  uint32_t numClear = _numCells - _lengths[gameNo];
+  if(numClear == 0){
+    _foodCells[gameNo] = Bitboard::noCell;
+    return;
+  }
+  std::uniform_int_distribution<uint32_t> distribution {0, numClear - 1};
+  _foodCells[gameNo] = findNthClear(gameNo, distribution(_rngs[gameNo]));
+}
+
+// As Bitboard::findNthClear.
+Snake::Cell_t WideSimulation::findNthClear(int gameNo, uint32_t n) const
+{
+  const Word_t* board = getBoard(gameNo);
+  for(int wordNo = 0; wordNo < _wordsPerBoard; ++wordNo){
+    Word_t clearBits = ~board[wordNo];
+    uint32_t numClear = __builtin_popcount(clearBits);
+    if(n >= numClear){
+      n -= numClear;
+      continue;
+    }
+    for(; n > 0; --n)
+      clearBits &= clearBits - 1;
+    return (wordNo * bitsPerWord) + __builtin_ctz(clearBits);
+  }
+  return Bitboard::noCell;
+}
+
+Vector2i WideSimulation::toPosition(Snake::Cell_t cell) const
+{
+  return Vector2i{static_cast<int32_t>(cell % _config._worldDimensions._x), 
+                  static_cast<int32_t>(cell / _config._worldDimensions._x)};
+}
+
+// Plays the game: decides the snake's next move each time it is asked, as a player would with
+// the arrow keys. The autopilot plans a path from the head to the food with A* (treating the 
+// body as it is when planning as walls, except a tail which will move on) and follows the path
+// until the food is eaten or the path is lost. A path is only taken if it is safe: if, once the
+// snake has followed it and eaten, the head could still reach the tail (and so follow the tail 
+// out of any pocket it is in). If there is no safe path the autopilot follows a path to where
+// its tail is, then plans again; if it cannot reach its tail either it falls back to the move
+// which leaves the head most room, trying first the move of a Hamiltonian cycle of the world (a
+// closed path through every cell), which it precomputes. A failed plan is not retried until the snake has moved; the world is unchanged until then.
+//
+// Each search gives up once it has reached maxSearchCells cells, which bounds the time of a 
+// plan on large worlds, where a long body between the head and the food can make a search
+// flood much of the world. If a search for the food or the tail gives up, the autopilot follows
+// the path to the cell the search was expanding (the deepest cell of least f, so the furthest 
+// along the cheapest way round found so far) and plans again from there.
 //
-// note: virtual pixel sizes are limited to integer mulitiples of real pixels, i.e. integers.
+// Planning allocates nothing and clears nothing: the per-cell search state (visited and the 
+// direction each cell was reached by) is stamped with a generation number which is incremented
+// for each search, so cells stamped by earlier searches read as unvisited. The open set is a 
+// bucket queue rather than a heap: moving one cell changes the (wrapped manhattan) heuristic by
+// at most 1, so each cell's f cost is 0, 1 or 2 more than that of the cell it was reached from,
+// and 3 buckets (indexed by f mod 3) hold the whole open set in f order; pushes and pops are 
+// O(1). Each bucket is a stack, so ties in f go to the deepest cell (largest g): on an open 
+// torus every cell in the rectangle between start and goal has the same f, and popping ties in
+// the order they were pushed would flood the whole rectangle before reaching the goal.
 //
-class Screen
+// note: cells are closed when first reached, so paths are not always shortest, but are short.
+// note: a Hamiltonian cycle of a grid needs an even width or height; on odd by odd worlds the 
+// fallback is any move which is not blocked.
+//
+// references:
+//   [0] https://en.wikipedia.org/wiki/A*_search_algorithm
+//   [1] https://en.wikipedia.org/wiki/Bucket_queue
+class Autopilot
 {
 public:
-  Screen(Vector2i windowSize);
-  ~Screen() = default;
-  void clear(const Color4& color);
-  void clear(iRect region, const Color4& color);
-  void drawPixel(int row, int col, const Color4& color);
-  void drawSprite(int x, int y, const Sprite& sprite);
-  void rescalePixels(Vector2i windowSize);
-  void render();
+  using Clock_t = std::chrono::steady_clock;
+  using Duration_t = std::chrono::nanoseconds;
+  struct Stats
+  {
+    int64_t _numDecisions;
+    int64_t _numPlans;                  // incl failed plans.
+    int64_t _numUnsafePaths;            // paths to the food rejected as unsafe.
+    int64_t _numPartialPaths;           // paths from searches which gave up.
+    int64_t _numFallbacks;              // decisions made without a path.
+    Duration_t _totalDecisionTime;      // incl planning.
+    Duration_t _totalPlanTime;
+    Duration_t _maxPlanTime;
+  };
+public:
+  Autopilot(Vector2i worldDimensions);
+  ~Autopilot() = default;
+  Snake::MoveDirection decide(const Simulation& simulation);
+  void reset();
+  const Stats& getStats() const {return _stats;}
+private:
+  static constexpr std::array<Snake::MoveDirection, 4> reverseDirections {
+    Snake::SOUTH, Snake::NORTH, Snake::WEST, Snake::EAST
+  };
+
+  static constexpr uint32_t maxSearchCells {1 << 15};
+  static constexpr uint16_t maxGeneration {(1 << 14) - 1};
+private:
+  bool planPath(const Simulation& simulation);
+  bool search(const Snake& snake, const Bitboard& occupancy, Snake::Cell_t start, 
+              Snake::Cell_t goal, Snake::Cell_t leavingCell, uint32_t roomNumCells);
+  void tracePath(const Snake& snake, Snake::Cell_t start, Snake::Cell_t goal);
+  bool isPathSafe(const Simulation& simulation);
+  Snake::MoveDirection seekRoom(const Snake& snake);
+  int getHeuristic(Snake::Cell_t cell, Vector2i goal) const;
+  void buildCycle();
+private:
+  Vector2i _worldDimensions;
+  uint32_t _numCells;
+
+  // search state per cell: the generation of the search which reached the cell in the high 14
+  // bits and the direction it was reached by in the low 2; valid only if the generation is the
+  // current generation. Packed in 16 bits to halve the memory a search touches.
+  std::vector<uint16_t> _stamps;
+  uint16_t _generation;
+  Snake::Cell_t _givenUpCell;         // cell the last search was expanding if it gave up.
+  uint32_t _numSearchCells;           // cells reached by the last search (incl its start).
+
+  std::array<std::vector<Snake::Cell_t>, 3> _buckets;
+
+  // the planned path; step n moves in direction n into cell n. Steps before _pathNo are taken.
+  std::vector<Snake::Cell_t> _pathCells;
+  std::vector<Snake::MoveDirection> _pathDirections;
+  Snake::Cell_t _pathStartCell;
+  Snake::Cell_t _pathFoodCell;
+  size_t _pathNo;
+
+  int64_t _failedPlanStepNo;          // simulation step of the last failed plan; -1 if none.
+
+  Bitboard _virtualOccupancy;         // the body as it will be once the path is followed.
+
+  std::vector<Snake::MoveDirection> _cycleDirections;   // direction of the cycle out of each cell.
+
+  Stats _stats;
+};
+
+Autopilot::Autopilot(Vector2i worldDimensions) :
+  _worldDimensions{worldDimensions},
+  _numCells{static_cast<uint32_t>(worldDimensions._x * worldDimensions._y)},
+  _stamps(_numCells, 0),
+  _generation{0},
+  _givenUpCell{Bitboard::noCell},
+  _numSearchCells{0},
+  _buckets{},
+  _pathCells{},
+  _pathDirections{},
+  _pathStartCell{Bitboard::noCell},
+  _pathFoodCell{Bitboard::noCell},
+  _pathNo{0},
+  _failedPlanStepNo{-1},
+  _virtualOccupancy{worldDimensions},
+  _cycleDirections{},
+  _stats{0, 0, 0, 0, 0, Duration_t::zero(), Duration_t::zero(), Duration_t::zero()}
+{
+  for(auto& bucket : _buckets)
+    bucket.reserve(_numCells);
+  _pathCells.reserve(_numCells);
+  _pathDirections.reserve(_numCells);
+  buildCycle();
+}
+
+// Decides the move to make from the snake's current cell. May be called any number of times 
+// between moves.
+Snake::MoveDirection Autopilot::decide(const Simulation& simulation)
+{
+  auto now0 = Clock_t::now();
+  const Snake& snake = simulation.getSnake();
+  Snake::Cell_t head = snake.getHeadCell();
+
+  // advances along the path if the snake has moved along it since the last decision.
+  if(_pathNo < _pathCells.size() && head == _pathCells[_pathNo])
+    ++_pathNo;
+
+  Snake::Cell_t pathHead = (_pathNo == 0) ? _pathStartCell : _pathCells[_pathNo - 1];
+  bool isOnPath = _pathNo < _pathCells.size() && head == pathHead &&
+                  simulation.getFoodCell() == _pathFoodCell &&
+                  !snake.isMoveBlocked(_pathDirections[_pathNo]);
+  if(!isOnPath && simulation.getFoodCell() != Bitboard::noCell && 
+     simulation.getNumSteps() != _failedPlanStepNo)
+    isOnPath = planPath(simulation);
+
+  Snake::MoveDirection direction;
+  if(isOnPath)
+    direction = _pathDirections[_pathNo];
+  else{
+    direction = seekRoom(snake);
+    ++_stats._numFallbacks;
+  }
+
+  ++_stats._numDecisions;
+  _stats._totalDecisionTime += Clock_t::now() - now0;
+  return direction;
+}
+
+// Forgets the planned path; call when the simulation restarts.
+void Autopilot::reset()
+{
+  _pathCells.clear();
+  _pathDirections.clear();
+  _pathStartCell = Bitboard::noCell;
+  _pathFoodCell = Bitboard::noCell;
+  _pathNo = 0;
+  _failedPlanStepNo = -1;
+}
+
+// Plans a safe path to the food, or else a path to the tail; on success the path replaces any
+// old path.
+bool Autopilot::planPath(const Simulation& simulation)
+{
+  auto now0 = Clock_t::now();
+  const Snake& snake = simulation.getSnake();
+  Snake::Cell_t head = snake.getHeadCell();
+  Snake::Cell_t food = simulation.getFoodCell();
+  Snake::Cell_t tail = snake.getTailCell();
+  Snake::Cell_t leavingCell = (snake.getGrowth() == 0) ? tail : Bitboard::noCell;
+
+  bool isFound = search(snake, snake.getOccupancy(), head, food, leavingCell, _numCells);
+  Snake::Cell_t goal = isFound ? food : _givenUpCell;
+  if(goal != Bitboard::noCell && goal != head){
+    _stats._numPartialPaths += isFound ? 0 : 1;
+    tracePath(snake, head, goal);
+    isFound = isPathSafe(simulation);
+    _stats._numUnsafePaths += isFound ? 0 : 1;
+  }
+
+  // the cells of a path to the tail stay clear as it is followed: the body only grows into the
+  // cells of the path and the tail only leaves cells. A path which stops short of the tail may
+  // lead anywhere, so is tested like a path to the food.
+  if(!isFound){
+    isFound = search(snake, snake.getOccupancy(), head, tail, leavingCell, _numCells);
+    goal = isFound ? tail : _givenUpCell;
+    if(goal != Bitboard::noCell && goal != head){
+      tracePath(snake, head, goal);
+      if(!isFound){
+        ++_stats._numPartialPaths;
+        isFound = isPathSafe(simulation);
+        _stats._numUnsafePaths += isFound ? 0 : 1;
+      }
+    }
+  }
+
+  if(isFound){
+    _pathStartCell = head;
+    _pathFoodCell = food;
+    _pathNo = 0;
+  }
+  else{
+    _pathCells.clear();
+    _pathDirections.clear();
+    _failedPlanStepNo = simulation.getNumSteps();
+  }
+
+  Duration_t planTime = Clock_t::now() - now0;
+  ++_stats._numPlans;
+  _stats._totalPlanTime += planTime;
+  _stats._maxPlanTime = std::max(_stats._maxPlanTime, planTime);
+  return isFound;
+}
+
+// Searches for a path from start to goal around the cells set in the occupancy, except the 
+// leaving cell (a tail which moves on before the head arrives). The goal may be occupied (a 
+// tail to chase) but then can only be entered on the first move if it is the leaving cell. On
+// success the stamps of the path's cells hold the directions they were reached by.
+//
+// The search also succeeds, without a path, once it has reached roomNumCells cells (incl the 
+// start); searches which need the path pass _numCells, which is never reached. It fails, and 
+// keeps the cell it was expanding as _givenUpCell, once it has reached maxSearchCells cells.
+bool Autopilot::search(const Snake& snake, const Bitboard& occupancy, Snake::Cell_t start, 
+                       Snake::Cell_t goal, Snake::Cell_t leavingCell, uint32_t roomNumCells)
+{
+  Vector2i goalPosition = snake.toPosition(goal);
+
+  if(++_generation > maxGeneration){   // stamps wrap; old stamps could read as current.
+    std::fill(_stamps.begin(), _stamps.end(), 0);
+    _generation = 1;
+  }
+  _givenUpCell = Bitboard::noCell;
+  for(auto& bucket : _buckets)
+    bucket.clear();
+
+  int f = getHeuristic(start, goalPosition);
+  _stamps[start] = _generation << 2;
+  _buckets[f % 3].push_back(start);
+  _numSearchCells = 1;
+  int numEmptyBuckets {0};
+  while(numEmptyBuckets < 3){
+    std::vector<Snake::Cell_t>& bucket = _buckets[f % 3];
+    if(bucket.empty()){                // reused for f + 3.
+      ++numEmptyBuckets;
+      ++f;
+      continue;
+    }
+    numEmptyBuckets = 0;
+    Snake::Cell_t cell = bucket.back();
+    bucket.pop_back();
+    int g = f - getHeuristic(cell, goalPosition);
+    for(auto direction : {Snake::NORTH, Snake::SOUTH, Snake::EAST, Snake::WEST}){
+      Snake::Cell_t next = snake.stepCell(cell, direction);
+      if((_stamps[next] >> 2) == _generation)
+        continue;
+      bool isBlocked = occupancy.test(next) && next != leavingCell;
+      if(next == goal && (cell != start || !isBlocked)){
+        _stamps[next] = (_generation << 2) | direction;
+        return true;
+      }
+      if(isBlocked)
+        continue;
+      if(++_numSearchCells == roomNumCells)
+        return true;
+      if(_numSearchCells == maxSearchCells){
+        _givenUpCell = cell;
+        return false;
+      }
+      _stamps[next] = (_generation << 2) | direction;
+      int nextF = g + 1 + getHeuristic(next, goalPosition);
+      _buckets[nextF % 3].push_back(next);
+    }
+  }
+  return false;
+}
+
+// Copies the path found by the last search into the path.
+void Autopilot::tracePath(const Snake& snake, Snake::Cell_t start, Snake::Cell_t goal)
+{
+  size_t length {0};
+  for(Snake::Cell_t cell = goal; cell != start; ){
+    cell = snake.stepCell(cell, reverseDirections[_stamps[cell] & 3]);
+    ++length;
+  }
+  _pathCells.resize(length);
+  _pathDirections.resize(length);
+  Snake::Cell_t cell = goal;
+  for(size_t i = length; i-- > 0;){
+    _pathCells[i] = cell;
+    _pathDirections[i] = static_cast<Snake::MoveDirection>(_stamps[cell] & 3);
+    cell = snake.stepCell(cell, reverseDirections[_stamps[cell] & 3]);
+  }
+}
+
+// Tests if, once the snake has followed the path and eaten the food, the head could reach the 
+// tail. The body is then the path (newest cell first) followed by the body as it is now, cut 
+// to the snake's new length; the tail has moved once for each move made without growth.
+//
+// The path itself is a wall between the food and the tail, so a search around it can flood 
+// much of the world. It is cut short once the head is found to have room: maxSearchCells free
+// cells, which is enough for the head to wait in until the tail has moved on, unless the snake
+// is very long. A path which stops short of the food is tested as if the food were at its end,
+// which only makes the test stricter.
+bool Autopilot::isPathSafe(const Simulation& simulation)
+{
+  const Snake& snake = simulation.getSnake();
+  int pathLength = static_cast<int>(_pathCells.size());
+  int length = snake.getLength();
+  int growth = snake.getGrowth();
+  int numTailMoves = std::max(0, pathLength - growth);
+  int newLength = pathLength + length - numTailMoves;
+  int newGrowth = std::max(0, growth - pathLength) + simulation.getConfig()._growthPerFood;
+
+  _virtualOccupancy = snake.getOccupancy();
+  for(int i = 0; i < std::min(numTailMoves, length); ++i)
+    _virtualOccupancy.reset(snake.getCell(length - 1 - i));
+  for(int i = std::max(0, numTailMoves - length); i < pathLength; ++i)
+    _virtualOccupancy.set(_pathCells[i]);
+
+  Snake::Cell_t head = _pathCells.back();
+  Snake::Cell_t tail = (newLength <= pathLength) ? _pathCells[pathLength - newLength] : 
+                                                   snake.getCell(newLength - pathLength - 1);
+  if(tail == head)
+    return true;
+  Snake::Cell_t leavingCell = (newGrowth == 0) ? tail : Bitboard::noCell;
+  return search(snake, _virtualOccupancy, head, tail, leavingCell, maxSearchCells);
+}
+
+// Makes the move which leaves the head most room: the first move after which the tail (or as
+// many cells as a search may reach) can be reached, else the move after which the most cells 
+// can be reached. The cycle's move is tried first, as it packs the body tightly when the world
+// is nearly full.
+Snake::MoveDirection Autopilot::seekRoom(const Snake& snake)
+{
+  Snake::Cell_t tail = snake.getTailCell();
+  Snake::Cell_t leavingCell = (snake.getGrowth() == 0) ? tail : Bitboard::noCell;
+  Snake::MoveDirection cycleDirection = _cycleDirections.empty() ? snake.getMoveDirection() : 
+                                                                   _cycleDirections[snake.getHeadCell()];
+  std::array<Snake::MoveDirection, 5> directions {
+    cycleDirection, Snake::NORTH, Snake::SOUTH, Snake::EAST, Snake::WEST
+  };
+  Snake::MoveDirection bestDirection = snake.getMoveDirection();     // boxed in.
+  uint32_t bestRoom {0};
+  for(size_t i = 0; i < directions.size(); ++i){
+    Snake::MoveDirection direction = directions[i];
+    if((i > 0 && direction == cycleDirection) || snake.isMoveBlocked(direction))
+      continue;
+    Snake::Cell_t next = snake.getNextHeadCell(direction);
+    if(next == leavingCell || search(snake, snake.getOccupancy(), next, tail, leavingCell, 
+                                     maxSearchCells))
+      return direction;
+    if(_numSearchCells > bestRoom){
+      bestDirection = direction;
+      bestRoom = _numSearchCells;
+    }
+  }
+  return bestDirection;
+}
+
+// The manhattan distance to the goal on the wrapping world.
+int Autopilot::getHeuristic(Snake::Cell_t cell, Vector2i goal) const
+{
+  int dx = std::abs(static_cast<int>(cell % _worldDimensions._x) - goal._x);
+  int dy = std::abs(static_cast<int>(cell / _worldDimensions._x) - goal._y);
+  return std::min(dx, _worldDimensions._x - dx) + std::min(dy, _worldDimensions._y - dy);
+}
+
+// Builds a cycle which snakes along the rows between cols 1 and width - 1 and returns down col 0,
+// e.g. on a 4x4 world (row 0 at the bottom):
+//
+//   v < < <
+//   v > > ^
+//   v ^ < <
+//   > > > ^
+//
+// For an odd number of rows the cycle is built the same way on the transposed world.
+void Autopilot::buildCycle()
+{
+  int width = _worldDimensions._x;
+  int height = _worldDimensions._y;
+  bool isTransposed = (height % 2 != 0);
+  if(isTransposed)
+    std::swap(width, height);
+  if(height % 2 != 0 || width < 2)
+    return;
+
+  // in the transposed world east is north (and west is south).
+  Snake::MoveDirection east = isTransposed ? Snake::NORTH : Snake::EAST;
+  Snake::MoveDirection west = isTransposed ? Snake::SOUTH : Snake::WEST;
+  Snake::MoveDirection north = isTransposed ? Snake::EAST : Snake::NORTH;
+  Snake::MoveDirection south = isTransposed ? Snake::WEST : Snake::SOUTH;
+
+  _cycleDirections.resize(_numCells);
+  for(int row = 0; row < height; ++row){
+    for(int col = 0; col < width; ++col){
+      Snake::MoveDirection direction;
+      if(col == 0)
+        direction = (row == 0) ? east : south;
+      else if(row % 2 == 0)
+        direction = (col < width - 1) ? east : north;
+      else
+        direction = (col > 1) ? west : (row < height - 1) ? north : west;
+      int x = isTransposed ? row : col;
+      int y = isTransposed ? col : row;
+      _cycleDirections[(y * _worldDimensions._x) + x] = direction;
+    }
+  }
+}
+
+// Plays the game by Monte-Carlo tree search: for each move it plays many short random games
+// (rollouts) ahead from the current state, grows a tree of the moves tried and picks the move
+// whose rollouts went best [0]. The tree is open loop (nodes are sequences of moves, not states)
+// since the food lands at random; each rollout replays its moves from the root.
+//
+// Rollouts run in parallel on a number of threads, each growing its own tree from the same root
+// (root parallelization [1]); when a thread finishes it adds the visits and rewards of its root
+// moves to shared atomic totals, so the trees are merged without locks and the threads share 
+// nothing else while searching. The rollouts are split evenly between the threads so a search 
+// gives the same move on the same number of threads. The caller of decide searches as thread 0;
+// the other threads live as long as the bot and wait between searches for the search number to
+// change, so starting a search only takes a lock and a notify.
+//
+// Each thread has an arena of everything it uses (its tree, occupancy and body cells) which is
+// reused from move to move, so searching allocates nothing once warm. Rollouts do not copy the
+// snake; a rollout of at most _maxDepth moves can only move the tail through the _maxDepth
+// segments nearest it, so a rollout's state is the occupancy, those cells and the cells the head
+// enters. The occupancy is copied once per search and undone after each rollout from the body 
+// cells. The move rules are those of Snake::move and Simulation::step.
+//
+// references:
+//   [0] https://en.wikipedia.org/wiki/Monte_Carlo_tree_search
+//   [1] Chaslot et al, Parallel Monte-Carlo Tree Search, 2008.
+class MctsBot
+{
+public:
+  using Clock_t = std::chrono::steady_clock;
+  using Duration_t = std::chrono::nanoseconds;
+  struct Config
+  {
+    int _numThreads;
+    int _numRolloutsPerMove;            // split between the threads.
+    int _maxDepth;                      // unit: moves ahead of the snake, in tree and rollout.
+    uint32_t _seed;
+  };
+  struct Stats
+  {
+    int64_t _numDecisions;
+    int64_t _numRollouts;
+    int64_t _numRolloutMoves;
+    Duration_t _totalDecisionTime;
+  };
+  static constexpr Config defaultConfig {1, 1000, 64, 1};
+public:
+  MctsBot(Vector2i worldDimensions, const Config& config = defaultConfig);
+  ~MctsBot();
+  MctsBot(const MctsBot&) = delete;
+  MctsBot& operator=(const MctsBot&) = delete;
+  Snake::MoveDirection decide(const Simulation& simulation);
+  const Stats& getStats() const {return _stats;}
+private:
+  static constexpr int numDirections {4};
+  static constexpr float explorationWeight {1.414f};   // c of UCB1; about sqrt 2 for rewards in [0, 1].
+  static constexpr double rewardScale {1 << 20};       // of the fixed point merged rewards.
+  static constexpr std::array<Snake::MoveDirection, numDirections> reverseDirections {
+    Snake::SOUTH, Snake::NORTH, Snake::WEST, Snake::EAST
+  };
+
+  struct Node
+  {
+    std::array<int32_t, numDirections> _children;      // node index; -1 if not yet expanded.
+    int32_t _numVisits;
+    float _totalReward;
+  };
+
+  // the state of the game during a rollout.
+  struct Rollout
+  {
+    Snake::Cell_t _headCell;
+    Snake::MoveDirection _direction;
+    Snake::Cell_t _foodCell;
+    uint32_t _tailNo;                   // index of the tail in the arena's body cells.
+    int _length;
+    int _growth;
+    int _growthPerFood;
+    int _numFood;                       // eaten during the rollout.
+    int _numMoves;
+    Simulation::State _state;
+  };
+
+  // everything a thread uses to search, kept from move to move.
+  struct alignas(64) Arena
+  {
+    Arena(Vector2i worldDimensions) : 
+      _nodes{}, _path{}, _occupancy{worldDimensions}, _bodyCells{}, _numRootCells{0}, _rng{}, 
+      _numRolloutMoves{0} 
+    {}
+    std::vector<Node> _nodes;           // the tree; node 0 is the root.
+    std::vector<int32_t> _path;         // nodes visited by the current rollout.
+    Bitboard _occupancy;                // of the rollout.
+    std::vector<Snake::Cell_t> _bodyCells;  // tail first; the cells entered by a rollout follow.
+    uint32_t _numRootCells;             // body cells copied from the root snake.
+    std::mt19937 _rng;
+    int64_t _numRolloutMoves;
+  };
+private:
+  void searchMain(int threadNo);
+  void search(int threadNo, int numRollouts, const Simulation& simulation);
+  int getNumRollouts(int threadNo) const;
+  void resetRollout(Arena& arena, const Simulation& simulation, Rollout& rollout) const;
+  void move(Arena& arena, const Snake& snake, Rollout& rollout, Snake::MoveDirection direction) const;
+  uint32_t getLegalMoves(const Arena& arena, const Snake& snake, const Rollout& rollout) const;
+  Snake::MoveDirection choosePlayoutMove(Arena& arena, const Snake& snake, const Rollout& rollout, 
+                                         uint32_t legalMoves) const;
+  float getReward(const Rollout& rollout) const;
+private:
+  Config _config;
+  Vector2i _worldDimensions;
+  std::vector<Arena> _arenas;           // one per thread.
+  std::vector<std::thread> _threads;    // threads 1 and up; thread 0 is the caller of decide.
+
+  // the merged visits and rewards of the root moves of all threads, per direction.
+  std::array<std::atomic<int64_t>, numDirections> _rootVisits;
+  std::array<std::atomic<int64_t>, numDirections> _rootRewards;
+  // the search the threads are to run; guarded by _searchMutex.
+  std::mutex _searchMutex;
+  std::condition_variable _searchStarted;
+  std::condition_variable _searchDone;
+  const Simulation* _simulation;
+  int64_t _searchNo;
+  int _numThreadsSearching;
+  bool _isDone;
+
+  Stats _stats;
+};
+
+MctsBot::MctsBot(Vector2i worldDimensions, const Config& config) :
+  _config{config},
+  _worldDimensions{worldDimensions},
+  _arenas{},
+  _threads{},
+  _rootVisits{},
+  _rootRewards{},
+  _searchMutex{},
+  _searchStarted{},
+  _searchDone{},
+  _simulation{nullptr},
+  _searchNo{0},
+  _numThreadsSearching{0},
+  _isDone{false},
+  _stats{0, 0, 0, Duration_t::zero()}
+{
+  assert(config._numThreads > 0 && config._numRolloutsPerMove > 0 && config._maxDepth > 0);
+  for(int i = 0; i < config._numThreads; ++i)
+    _arenas.emplace_back(worldDimensions);
+  for(int threadNo = 1; threadNo < config._numThreads; ++threadNo)
+    _threads.emplace_back(&MctsBot::searchMain, this, threadNo);
+}
+
+MctsBot::~MctsBot()
+{
+  {
+    std::lock_guard<std::mutex> lock {_searchMutex};
+    _isDone = true;
+  }
+  _searchStarted.notify_all();
+  for(auto& thread : _threads)
+    thread.join();
+}
+
+// Searches for the best move from the current state; blocks until all threads are done.
+Snake::MoveDirection MctsBot::decide(const Simulation& simulation)
+{
+  auto now0 = Clock_t::now();
+  for(int i = 0; i < numDirections; ++i){
+    _rootVisits[i].store(0, std::memory_order_relaxed);
+    _rootRewards[i].store(0, std::memory_order_relaxed);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock {_searchMutex};
+    _simulation = &simulation;
+    _numThreadsSearching = static_cast<int>(_threads.size());
+    ++_searchNo;
+  }
+  _searchStarted.notify_all();
+  search(0, getNumRollouts(0), simulation);
+  {
+    std::unique_lock<std::mutex> lock {_searchMutex};
+    _searchDone.wait(lock, [this](){return _numThreadsSearching == 0;});
+  }
+
+  // the most visited move is the most robust choice; equally visited moves (common with few
+  // rollouts per thread) are told apart by their total reward.
+  const Snake& snake = simulation.getSnake();
+  Snake::MoveDirection best = snake.getMoveDirection();
+  int64_t bestVisits {0};
+  int64_t bestReward {0};
+  for(int i = 0; i < numDirections; ++i){
+    int64_t visits = _rootVisits[i].load(std::memory_order_relaxed);
+    int64_t reward = _rootRewards[i].load(std::memory_order_relaxed);
+    if(visits > bestVisits || (visits == bestVisits && visits > 0 && reward > bestReward)){
+      best = static_cast<Snake::MoveDirection>(i);
+      bestVisits = visits;
+      bestReward = reward;
+    }
+  }
+
+  ++_stats._numDecisions;
+  _stats._numRollouts += _config._numRolloutsPerMove;
+  for(auto& arena : _arenas){
+    _stats._numRolloutMoves += arena._numRolloutMoves;
+    arena._numRolloutMoves = 0;
+  }
+  _stats._totalDecisionTime += Clock_t::now() - now0;
+  return best;
+}
+
+// The main of threads 1 and up: runs each search as it is started until the bot is destroyed.
+void MctsBot::searchMain(int threadNo)
+{
+  int64_t searchNo {0};
+  while(true){
+    const Simulation* simulation;
+    {
+      std::unique_lock<std::mutex> lock {_searchMutex};
+      _searchStarted.wait(lock, [this, searchNo](){return _isDone || _searchNo != searchNo;});
+      if(_isDone)
+        return;
+      searchNo = _searchNo;
+      simulation = _simulation;
+    }
+    search(threadNo, getNumRollouts(threadNo), *simulation);
+    {
+      std::lock_guard<std::mutex> lock {_searchMutex};
+      if(--_numThreadsSearching == 0)
+        _searchDone.notify_one();
+    }
+  }
+}
+
+// A thread's share of the rollouts of each search; the remainder goes to the first threads.
+int MctsBot::getNumRollouts(int threadNo) const
+{
+  int numThreads = _config._numThreads;
+  return (_config._numRolloutsPerMove / numThreads) + 
+         ((threadNo < _config._numRolloutsPerMove % numThreads) ? 1 : 0);
+}
+
+// Runs a thread's share of the rollouts, growing its tree, then merges its root moves.
+void MctsBot::search(int threadNo, int numRollouts, const Simulation& simulation)
+{
+  Arena& arena = _arenas[threadNo];
+  const Snake& snake = simulation.getSnake();
+
+  // seeded per thread and move so a search does not depend on thread timing.
+  arena._rng.seed(_config._seed + (static_cast<uint32_t>(_stats._numDecisions) * 7919u) + 
+                  (static_cast<uint32_t>(threadNo) * 104729u));
+
+  arena._occupancy = snake.getOccupancy();
+  int numRootCells = std::min(snake.getLength(), _config._maxDepth);
+  arena._bodyCells.clear();
+  for(int segmentNo = snake.getLength() - 1; segmentNo >= snake.getLength() - numRootCells; --segmentNo)
+    arena._bodyCells.push_back(snake.getCell(segmentNo));
+  arena._numRootCells = numRootCells;
+
+  arena._nodes.clear();
+  arena._nodes.push_back(Node{{-1, -1, -1, -1}, 0, 0.f});
+
+  Rollout rollout {};
+  for(int rolloutNo = 0; rolloutNo < numRollouts; ++rolloutNo){
+    resetRollout(arena, simulation, rollout);
+    arena._path.clear();
+    int32_t nodeNo {0};
+    arena._path.push_back(nodeNo);
+
+    // selection and expansion: descends the tree by UCB1 until a move not yet in the tree.
+    bool isExpanded {false};
+    while(!isExpanded && rollout._state == Simulation::STATE_PLAYING && rollout._numMoves < _config._maxDepth){
+      uint32_t legalMoves = getLegalMoves(arena, snake, rollout);
+      if(legalMoves == 0){
+        rollout._state = Simulation::STATE_DEAD;
+        break;
+      }
+      int numUnexpanded {0};
+      for(int i = 0; i < numDirections; ++i)
+        numUnexpanded += ((legalMoves >> i) & 1) && arena._nodes[nodeNo]._children[i] == -1;
+
+      int direction {-1};
+      if(numUnexpanded > 0){
+        int n = std::uniform_int_distribution<int>{0, numUnexpanded - 1}(arena._rng);
+        for(int i = 0; i < numDirections && direction == -1; ++i)
+          if(((legalMoves >> i) & 1) && arena._nodes[nodeNo]._children[i] == -1 && n-- == 0)
+            direction = i;
+        arena._nodes[nodeNo]._children[direction] = static_cast<int32_t>(arena._nodes.size());
+        arena._nodes.push_back(Node{{-1, -1, -1, -1}, 0, 0.f});
+        isExpanded = true;
+      }
+      else{
+        float logVisits = std::log(static_cast<float>(arena._nodes[nodeNo]._numVisits));
+        float bestScore = -1.f;
+        for(int i = 0; i < numDirections; ++i){
+          if(!((legalMoves >> i) & 1))
+            continue;
+          const Node& child = arena._nodes[arena._nodes[nodeNo]._children[i]];
+          float score = (child._totalReward / child._numVisits) + 
+                        explorationWeight * std::sqrt(logVisits / child._numVisits);
+          if(score > bestScore){
+            bestScore = score;
+            direction = i;
+          }
+        }
+      }
+      nodeNo = arena._nodes[nodeNo]._children[direction];
+      arena._path.push_back(nodeNo);
+      move(arena, snake, rollout, static_cast<Snake::MoveDirection>(direction));
+    }
+
+    // playout: plays on from the new node with a cheap policy.
+    while(rollout._state == Simulation::STATE_PLAYING && rollout._numMoves < _config._maxDepth){
+      uint32_t legalMoves = getLegalMoves(arena, snake, rollout);
+      if(legalMoves == 0){
+        rollout._state = Simulation::STATE_DEAD;
+        break;
+      }
+      move(arena, snake, rollout, choosePlayoutMove(arena, snake, rollout, legalMoves));
+    }
+
+    float reward = getReward(rollout);
+    for(int32_t pathNodeNo : arena._path){
+      ++arena._nodes[pathNodeNo]._numVisits;
+      arena._nodes[pathNodeNo]._totalReward += reward;
+    }
+    arena._numRolloutMoves += rollout._numMoves;
+  }
+
+  const Node& root = arena._nodes[0];
+  for(int i = 0; i < numDirections; ++i){
+    if(root._children[i] == -1)
+      continue;
+    const Node& child = arena._nodes[root._children[i]];
+    _rootVisits[i].fetch_add(child._numVisits, std::memory_order_relaxed);
+    _rootRewards[i].fetch_add(static_cast<int64_t>(child._totalReward * rewardScale), 
+                              std::memory_order_relaxed);
+  }
+}
+
+// Undoes the last rollout (if any) and starts a new one at the root.
+void MctsBot::resetRollout(Arena& arena, const Simulation& simulation, Rollout& rollout) const
+{
+  // cells entered are cleared first since the tail may have left a root cell before the head
+  // entered it again.
+  for(size_t i = arena._numRootCells; i < arena._bodyCells.size(); ++i)
+    arena._occupancy.reset(arena._bodyCells[i]);
+  arena._bodyCells.resize(arena._numRootCells);
+  for(uint32_t i = 0; i < std::min(rollout._tailNo, arena._numRootCells); ++i)
+    arena._occupancy.set(arena._bodyCells[i]);
+
+  const Snake& snake = simulation.getSnake();
+  rollout._headCell = snake.getHeadCell();
+  rollout._direction = snake.getMoveDirection();
+  rollout._foodCell = simulation.getFoodCell();
+  rollout._tailNo = 0;
+  rollout._length = snake.getLength();
+  rollout._growth = snake.getGrowth();
+  rollout._growthPerFood = simulation.getConfig()._growthPerFood;
+  rollout._numFood = 0;
+  rollout._numMoves = 0;
+  rollout._state = simulation.getState();
+}
+
+// As Snake::move followed by eating the food as Simulation::step; the move must be legal.
+void MctsBot::move(Arena& arena, const Snake& snake, Rollout& rollout, Snake::MoveDirection direction) const
+{
+  if(rollout._growth > 0){
+    ++rollout._length;
+    --rollout._growth;
+  }
+  else
+    arena._occupancy.reset(arena._bodyCells[rollout._tailNo++]);
+  rollout._headCell = snake.stepCell(rollout._headCell, direction);
+  rollout._direction = direction;
+  arena._occupancy.set(rollout._headCell);
+  arena._bodyCells.push_back(rollout._headCell);
+  ++rollout._numMoves;
+
+  if(rollout._headCell == rollout._foodCell){
+    ++rollout._numFood;
+    rollout._growth += rollout._growthPerFood;
+    uint32_t numClear = arena._occupancy.getNumClear();
+    if(numClear == 0){
+      rollout._foodCell = Bitboard::noCell;
+      rollout._state = Simulation::STATE_WON;
+      return;
+    }
+    uint32_t n = std::uniform_int_distribution<uint32_t>{0, numClear - 1}(arena._rng);
+    rollout._foodCell = arena._occupancy.findNthClear(n);
+  }
+}
+
+// The moves which are not reversals and do not run into the body, as a bit per direction.
+uint32_t MctsBot::getLegalMoves(const Arena& arena, const Snake& snake, const Rollout& rollout) const
+{
+  uint32_t legalMoves {0};
+  for(int i = 0; i < numDirections; ++i){
+    auto direction = static_cast<Snake::MoveDirection>(i);
+    if(rollout._length > 1 && direction == reverseDirections[rollout._direction])
+      continue;
+    Snake::Cell_t next = snake.stepCell(rollout._headCell, direction);
+    bool isBlocked = arena._occupancy.test(next) && 
+                     (next != arena._bodyCells[rollout._tailNo] || rollout._growth > 0);
+    legalMoves |= isBlocked ? 0 : (1u << i);
+  }
+  return legalMoves;
+}
+
+// Half the time steers toward the food (by the wrapped distance), else moves at random; pure
+// random snakes seldom reach food within a rollout.
+Snake::MoveDirection MctsBot::choosePlayoutMove(Arena& arena, const Snake& snake, const Rollout& rollout,
+                                                uint32_t legalMoves) const
+{
+  if(arena._rng() & 1){
+    auto getDistance = [this](Snake::Cell_t a, Snake::Cell_t b){
+      int width = _worldDimensions._x;
+      int dx = std::abs(static_cast<int>(a % width) - static_cast<int>(b % width));
+      int dy = std::abs(static_cast<int>(a / width) - static_cast<int>(b / width));
+      return std::min(dx, width - dx) + std::min(dy, _worldDimensions._y - dy);
+    };
+    int best {-1};
+    int bestDistance = std::numeric_limits<int>::max();
+    for(int i = 0; i < numDirections; ++i){
+      if(!((legalMoves >> i) & 1))
+        continue;
+      Snake::Cell_t next = snake.stepCell(rollout._headCell, static_cast<Snake::MoveDirection>(i));
+      int distance = getDistance(next, rollout._foodCell);
+      if(distance < bestDistance){
+        best = i;
+        bestDistance = distance;
+      }
+    }
+    return static_cast<Snake::MoveDirection>(best);
+  }
+  int n = std::uniform_int_distribution<int>{0, __builtin_popcount(legalMoves) - 1}(arena._rng);
+  for(int i = 0; i < numDirections; ++i)
+    if(((legalMoves >> i) & 1) && n-- == 0)
+      return static_cast<Snake::MoveDirection>(i);
+  return rollout._direction;
+}
+
+// In [0, 1]: nothing for dying, half for surviving, more for each food eaten on the way.
+float MctsBot::getReward(const Rollout& rollout) const
+{
+  switch(rollout._state)
+  {
+  case Simulation::STATE_DEAD:
+    return 0.f;
+  case Simulation::STATE_WON:
+    return 1.f;
+  default:
+    return 1.f - (0.5f / (1 + rollout._numFood));
+  }
+}
+
+#ifndef SK_SIM_ONLY
+
+class Game
+{
+public:
+  enum ColorID { 
+    COLOR_WORLD_BACKGROUND,
+    COLOR_SNAKE_BODY_LIGHT,
+    COLOR_SNAKE_BODY_SHADED,
+    COLOR_SNAKE_BODY_SHADOW,
+    COLOR_SNAKE_EYES,
+    COLOR_SNAKE_TONGUE,
+    COLOR_SNAKE_SPOTS,
+    COLOR_FOOD
+  };
+  enum AssetID {
+    ASSET_SNAKE_INDEXED,
+    ASSET_COUNT
+  };
+public:
+  Game();
+  ~Game() = default;
+  void requestAssets();
+  void generateSprites();
+  void onTick(float dt);
+  void onAiTick();
+  void draw(float interpolation);
+  void setAutopilot(bool isOn) {_isAutopilotOn = isOn;}
+  bool isAutopilotOn() const {return _isAutopilotOn;}
+  const Autopilot::Stats& getAutopilotStats() const {return _autopilot.getStats();}
 private:
-  // 12 byte pixels designed to work with glInterleavedArrays format GL_C4UB_V2F.
-  struct Pixel
-  {
-    Color4 _color;
-    float _x;
-    float _y;
+  static constexpr Vector2i worldDimensions {50, 50}; // [x:width(num cols), y:height(num rows)]
+
+  // all assets the game loads at startup, indexed by AssetID. Assets are taken from the sprite
+  // pack if it has them and otherwise loaded from their bmps.
+  static constexpr std::array<const char*, ASSET_COUNT> assetManifest {
+    "indexed4Colors.bmp"
+  };
+
+  // handle of assets which are embedded or found in the sprite pack, which thus need no loading.
+  static constexpr AssetLoader::Handle_t packedAssetHandle {-1};
+  static constexpr AssetLoader::Handle_t embeddedAssetHandle {-2};
+
+  static constexpr std::array<Color4, 8> palette {
+    colors::jet,
+    Color4(255, 217,  0),
+    Color4(172, 146,  0),
+    Color4( 42,  42, 42),
+    Color4(214,   0,  0),
+    Color4(214,   0,  0),
+    Color4(  4,  69,  0),
+    Color4(255, 106,  0)
+  };
+
+  static constexpr int snakeBlockWidth {4};
+  static constexpr int snakeBlockHeight {4};
+  static constexpr std::array<Color4, snakeBlockWidth * snakeBlockHeight> snakeBlockPixels {
+    palette[3], palette[3], palette[3], palette[3], 
+    palette[2], palette[2], palette[2], palette[2], 
+    palette[1], palette[1], palette[1], palette[1], 
+    palette[6], palette[1], palette[1], palette[1]
+  };
+
+  // pixels of this color in the snake sprites are transparent.
+  static constexpr Color4 snakeColorKey {colors::magenta};
+
+  static constexpr float scrollSpeed {40.f};   // screen pixels per second.
+
+  // the world is drawn as a grid of square cells centered on the screen.
+  static constexpr int worldCellSize {3};       // unit: screen pixels.
+  static constexpr Vector2i worldOrigin {
+    (Screen::screenWidth - (worldDimensions._x * worldCellSize)) / 2,
+    (Screen::screenHeight - (worldDimensions._y * worldCellSize)) / 2
   };
+
+  static constexpr float moveFrequency {8.f};             // unit: move (cell) jumps per second.
+  static constexpr float movePeriod {1 / moveFrequency};
+  // the color each snake segment is drawn in, indexed by Snake::SegmentType.
+  static constexpr std::array<ColorID, Snake::SEGMENT_TYPE_COUNT> segmentColors {
+    COLOR_SNAKE_BODY_LIGHT, COLOR_SNAKE_BODY_LIGHT, COLOR_SNAKE_BODY_LIGHT, COLOR_SNAKE_BODY_LIGHT,
+    COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED,
+    COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED, COLOR_SNAKE_BODY_SHADED,
+    COLOR_SNAKE_BODY_SHADOW, COLOR_SNAKE_BODY_SHADOW, COLOR_SNAKE_BODY_SHADOW, COLOR_SNAKE_BODY_SHADOW,
+    COLOR_SNAKE_SPOTS, COLOR_SNAKE_SPOTS, COLOR_SNAKE_SPOTS, COLOR_SNAKE_SPOTS
+  };
+
+  static constexpr Simulation::Config simulationConfig {
+    worldDimensions,
+    4,                            // snake start length.
+    1                             // growth per food.
+  };
+  static constexpr uint32_t randomSeed {1};                // fixed so runs are reproducible.
 private:
-  static constexpr int screenWidth = 160;
-  static constexpr int screenHeight = 160;
-  static constexpr int pixelCount = screenWidth * screenHeight;
+  Sprite resolveAsset(AssetID asset);
 private:
-  Vector2i _position;
-  std::array<Pixel, pixelCount> _pixels; // flattened 2D array accessed (col + (row * width))
-  int _pixelSize;
+  std::array<AssetLoader::Handle_t, ASSET_COUNT> _assetHandles;
+
+  // Sprite assets.
+  std::vector<Sprite> _snakeSprites;
+  std::vector<TransparentSprite> _transparentSnakeSprites;   // compiled from _snakeSprites.
+  std::vector<IndexedSprite> _indexedSnakeSprites;           // indexed screens only.
+
+  // the x position of the scrolling sprite at the previous and current tick.
+  float _scrollX0;
+  float _scrollX1;
+
+  Simulation _simulation;
+  float _moveClock;
+
+  Autopilot _autopilot;
+  bool _isAutopilotOn;                  // if on the autopilot steers and the arrow keys do not.
 };
 
-Screen::Screen(Vector2i windowSize)
+Game::Game() :
+  _scrollX0{0.f},
+  _scrollX1{0.f},
+  _simulation{simulationConfig, randomSeed},
+  _moveClock{0.f},
+  _autopilot{worldDimensions},
+  _isAutopilotOn{false}
 {
-  rescalePixels(windowSize);
 }
 
-void Screen::clear(const Color4& color)
+// Queues all manifest assets on the asset loader so they decode in the background; must be
+// followed by a call to generateSprites to collect them.
+void Game::requestAssets()
 {
-  for(auto& pixel : _pixels)
-    pixel._color = color;
+  for(int i = 0; i < ASSET_COUNT; ++i){
+    if(findEmbeddedSprite(assetManifest[i]) != nullptr)
+      _assetHandles[i] = embeddedAssetHandle;
+    else if(sk::spritePack && sk::spritePack->hasSprite(assetManifest[i]))
+      _assetHandles[i] = packedAssetHandle;
+    else
+      _assetHandles[i] = sk::assetLoader->loadBmp(assetManifest[i]);
+  }
 }
 
-void Screen::clear(iRect region, const Color4& color)
+// Gets the sprite of a requested asset, waiting for it to load if necessary. Assets which fail 
+// to load are replaced with empty sprites (which draw nothing).
+Sprite Game::resolveAsset(AssetID asset)
 {
+  Sprite sprite {};
+  if(_assetHandles[asset] == embeddedAssetHandle){
+    const EmbeddedSprite* embedded = findEmbeddedSprite(assetManifest[asset]);
+    return Sprite{embedded->_pixels, embedded->_width_px, embedded->_height_px};
+  }
+  if(_assetHandles[asset] == packedAssetHandle){
+    if(sk::spritePack->getSprite(assetManifest[asset], sprite) != 0)
+      sk::log->log(Log::ERROR, logstr::fail_load_asset, assetManifest[asset]);
+    return sprite;
+  }
 
-} 
+  Image image;
+  if(sk::assetLoader->wait(_assetHandles[asset], image) == 0)
+    sprite = Sprite{image.getPixels(), image.getWidth(), image.getHeight()};
+  return sprite;
+}
 
-void Screen::drawPixel(int row, int col, const Color4& color)
+void Game::generateSprites()
 {
-  assert(0 <= row && row < screenHeight);
-  assert(0 <= col && col < screenWidth);
-  _pixels[col + (row * screenWidth)]._color = color;
+  _snakeSprites.push_back(Sprite{snakeBlockPixels.data(), snakeBlockWidth, snakeBlockHeight});
+
+  _snakeSprites.push_back(resolveAsset(ASSET_SNAKE_INDEXED));
+
+  for(const auto& sprite : _snakeSprites)
+    _transparentSnakeSprites.emplace_back(sprite, TransparentSprite::KEY_COLOR, snakeColorKey);
+
+  if(sk::screen->getColorMode() == Screen::COLOR_INDEXED){
+    sk::screen->setPalette(palette.data(), palette.size());
+    for(size_t i = 0; i < _snakeSprites.size(); ++i){
+      _indexedSnakeSprites.emplace_back(_snakeSprites[i], palette.data(), palette.size(), snakeColorKey);
+      int numUnmapped = _indexedSnakeSprites.back().getNumUnmappedPixels();
+      if(numUnmapped > 0){
+        char addendum[48];
+        snprintf(addendum, sizeof(addendum), "{sprite:%d,pixels:%d}", static_cast<int>(i), numUnmapped);
+        sk::log->log(Log::WARN, logstr::warn_unmapped_colors, addendum);
+      }
+    }
+  }
 }
 
-void Screen::drawSprite(int x, int y, const Sprite& sprite)
+// Advances the game state by one fixed tick of dt seconds.
+void Game::onTick(float dt)
 {
-  assert(x >= 0 && y >= 0);
+  // the sprite scrolls east, wrapping from fully off the east edge to fully off the west edge.
+  int spriteWidth = _snakeSprites[1].getWidth();
+  float wrapWidth = static_cast<float>(sk::screen->getWidth() + spriteWidth);
+  _scrollX0 = _scrollX1;
+  _scrollX1 += scrollSpeed * dt;
+  if(_scrollX1 >= wrapWidth){
+    _scrollX0 -= wrapWidth;
+    _scrollX1 -= wrapWidth;
+  }
 
-  const std::vector<Color4>& spritePixels {sprite.getPixels()};
-  int spriteWidth {sprite.getWidth()};
-  int spriteHeight {sprite.getHeight()};
-  
-  int spritePixelNum {0};
-  for(int spriteRow = 0; spriteRow < spriteHeight; ++spriteRow){
-    // if next row is above the screen.
-    if(y + spriteRow >= screenHeight)
+  if(!_isAutopilotOn){
+    if(sk::input->isKeyDown(Input::KEY_UP))
+      _simulation.setMoveDirection(Snake::NORTH);
+    else if(sk::input->isKeyDown(Input::KEY_DOWN))
+      _simulation.setMoveDirection(Snake::SOUTH);
+    else if(sk::input->isKeyDown(Input::KEY_RIGHT))
+      _simulation.setMoveDirection(Snake::EAST);
+    else if(sk::input->isKeyDown(Input::KEY_LEFT))
+      _simulation.setMoveDirection(Snake::WEST);
+  }
+
+  _moveClock += dt;
+  while(_moveClock >= movePeriod){
+    _moveClock -= movePeriod;
+    if(_simulation.step() != Simulation::STATE_PLAYING){
+      const Snake& snake = _simulation.getSnake();
+      char addendum[64];
+      snprintf(addendum, sizeof(addendum), "{score:%d,length:%d}", _simulation.getScore(), 
+               snake.getLength());
+      sk::log->log(Log::INFO, logstr::info_game_over, addendum);
+      _simulation.restart();
+      _autopilot.reset();
       break;
+    }
+  }
+}
+
+// Steers the snake with the autopilot, if it is on; the ai ticks more often than the snake 
+// moves so the autopilot decides every move.
+void Game::onAiTick()
+{
+  if(_isAutopilotOn)
+    _simulation.setMoveDirection(_autopilot.decide(_simulation));
+}
 
-    // index of 1st screen pixel in next row being drawn.
-    int screenRowIndex {x + ((y + spriteRow) * screenWidth)};   
+// Draws the game state interpolated between the previous (0) and current (1) tick.
+void Game::draw(float interpolation)
+{
+  int scrollX = static_cast<int>(std::floor(_scrollX0 + ((_scrollX1 - _scrollX0) * interpolation)));
+  scrollX -= _snakeSprites[1].getWidth();
+
+  bool isIndexed = sk::screen->getColorMode() == Screen::COLOR_INDEXED;
+  if(isIndexed)
+    sk::screen->clear(static_cast<uint8_t>(COLOR_WORLD_BACKGROUND));
+  else
+    sk::screen->clear(colors::gainsboro);
+
+  auto drawCell = [isIndexed](Vector2i position, ColorID color){
+    iRect cellRect {worldOrigin._x + (position._x * worldCellSize), 
+                    worldOrigin._y + (position._y * worldCellSize), 
+                    worldCellSize, worldCellSize};
+    if(isIndexed)
+      sk::screen->clear(cellRect, static_cast<uint8_t>(color));
+    else
+      sk::screen->clear(cellRect, palette[color]);
+  };
 
-    for(int spriteCol = 0; spriteCol < spriteWidth; ++spriteCol){
-      // if the right side of the sprite falls outside the screen.
-      if(x + spriteCol >= screenWidth)
-        break;
+  const Snake& snake = _simulation.getSnake();
+  if(_simulation.getFoodCell() != Bitboard::noCell)
+    drawCell(snake.toPosition(_simulation.getFoodCell()), COLOR_FOOD);
+  for(int i = 0; i < snake.getLength(); ++i)
+    drawCell(snake.toPosition(snake.getCell(i)), segmentColors[snake.getSegmentType(i)]);
 
-      _pixels[screenRowIndex + spriteCol]._color = spritePixels[spritePixelNum];  
-      ++spritePixelNum;
-    }
+  if(isIndexed){
+    sk::screen->drawSprite(30, 30, _indexedSnakeSprites[0]);
+    sk::screen->drawSprite(scrollX, 50, _indexedSnakeSprites[1]);
+    return;
   }
+  sk::screen->drawSprite(30, 30, _transparentSnakeSprites[0]);
+  sk::screen->drawSprite(scrollX, 50, _transparentSnakeSprites[1]);
 }
 
-void Screen::rescalePixels(Vector2i windowSize)
+//------------------------------------------------------------------------------------------------
+//  APP                                                                                           
+//------------------------------------------------------------------------------------------------
+
+// Renders screen frames on a dedicated thread which owns the opengl context, so the swap (which
+// may block for vsync) and any driver stalls do not hold up input handling or simulation on the
+// main thread.
+//
+// Frames are triple buffered: the main thread captures into its write frame and publishes it 
+// as the pending frame, the render thread takes the pending frame as its read frame and renders
+// it. Publishing and taking only swap frame indices under the lock, so neither thread waits on 
+// the other's work. If the main thread publishes again before the render thread takes the 
+// pending frame, the pending frame is superseded (only the latest frame is rendered) but its
+// dirty regions are carried into the newer frame so the render thread's uploads stay complete.
+//
+// If the thread is not started, publish renders each frame on the calling thread before it 
+// returns; headless runs do so so that every frame is rendered (and timed).
+//
+// note: start releases the opengl context from the calling thread and stop returns it.
+class RenderThread
 {
-  int pixelWidth = windowSize._x / screenWidth; 
-  int pixelHeight = windowSize._y / screenHeight;
-  _pixelSize = std::min(pixelWidth, pixelHeight);
-  if(_pixelSize == 0)
-    _pixelSize = 1;
-  int pixelCenterOffset = _pixelSize / 2;
-  _position._x = std::clamp((windowSize._x - (_pixelSize * screenWidth)) / 2, 0, windowSize._x);
-  _position._y = std::clamp((windowSize._y - (_pixelSize * screenHeight)) / 2, 0, windowSize._y);
-  for(int col = 0; col < screenWidth; ++col){
-    for(int row = 0; row < screenHeight; ++row){
-      int index = col + (row * screenWidth);
-      Pixel& pixel = _pixels[index];
-      pixel._x = _position._x + (col * _pixelSize) + pixelCenterOffset;
-      pixel._y = _position._y + (row * _pixelSize) + pixelCenterOffset;
+public:
+  using Clock_t = std::chrono::steady_clock;
+  using Duration_t = std::chrono::nanoseconds;
+  struct Stats
+  {
+    int64_t _numFrames;                  // frames rendered.
+    int64_t _numSuperseded;              // frames published but never rendered.
+    Duration_t _totalRenderTime;         // clearing the window and drawing the screen.
+    Duration_t _maxRenderTime;
+    Duration_t _totalSwapTime;           // Renderer::show.
+    Duration_t _maxSwapTime;
+    ScreenPresenter::Stats _presenterStats;
+  };
+public:
+  RenderThread(const Color4& clearColor);
+  ~RenderThread();
+  RenderThread(const RenderThread&) = delete;
+  RenderThread& operator=(const RenderThread&) = delete;
+  void start();
+  void stop();
+  Screen::Frame& getWriteFrame() {return _frames[_writeNo];}
+  void publish();
+  void waitForTake();
+  Stats getStats() const;
+private:
+  void renderMain();
+  void render(const Screen::Frame& frame);
+private:
+  static constexpr int numFrames {3};
+private:
+  Color4 _clearColor;
+  std::vector<Screen::Frame> _frames;
+  int _writeNo;                          // owned by the main thread.
+  int _readNo;                           // owned by the render thread.
+  int _pendingNo;
+  bool _isPending;
+  bool _isDone;
+  std::thread _thread;
+  mutable std::mutex _mutex;
+  std::condition_variable _published;
+  std::condition_variable _taken;
+  ScreenPresenter _presenter;
+  Vector2i _windowSize;
+  Stats _stats;
+};
+
+RenderThread::RenderThread(const Color4& clearColor) :
+  _clearColor{clearColor},
+  _frames(numFrames),
+  _writeNo{0},
+  _readNo{1},
+  _pendingNo{2},
+  _isPending{false},
+  _isDone{false},
+  _thread{},
+  _presenter{},
+  _windowSize{0, 0},
+  _stats{0, 0, Duration_t{0}, Duration_t{0}, Duration_t{0}, Duration_t{0}, {0, 0, 0, 0}}
+{}
+
+RenderThread::~RenderThread()
+{
+  stop();
+}
+
+void RenderThread::start()
+{
+  assert(!_thread.joinable());
+  _isDone = false;
+  sk::renderer->makeContextCurrent(false);
+  _thread = std::thread{&RenderThread::renderMain, this};
+}
+
+// Renders the pending frame (if any) then stops the thread.
+void RenderThread::stop()
+{
+  if(!_thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock {_mutex};
+    _isDone = true;
+  }
+  _published.notify_one();
+  _thread.join();
+  sk::renderer->makeContextCurrent(true);
+}
+
+void RenderThread::publish()
+{
+  if(!_thread.joinable()){
+    render(_frames[_writeNo]);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock {_mutex};
+    if(_isPending){
+      const RectSet& supersededRects = _frames[_pendingNo]._dirtyRects;
+      RectSet& dirtyRects = _frames[_writeNo]._dirtyRects;
+      for(int i = 0; i < supersededRects.getNumRects(); ++i)
+        dirtyRects.add(supersededRects.getRects()[i]);
+      ++_stats._numSuperseded;
     }
+    std::swap(_writeNo, _pendingNo);
+    _isPending = true;
   }
+  _published.notify_one();
 }
 
-void Screen::render()
+// Blocks until the render thread has taken the pending frame; paces the main thread to the 
+// render thread, e.g. for vsync.
+void RenderThread::waitForTake()
 {
-  auto now0 = std::chrono::high_resolution_clock::now();
-  sk::renderer->drawPixelArray(0, pixelCount, static_cast<void*>(_pixels.data()), _pixelSize);
-  auto now1 = std::chrono::high_resolution_clock::now();
-  std::cout << "Screen::render execution time (us): "
-            << std::chrono::duration_cast<std::chrono::microseconds>(now1 - now0).count()
-            << std::endl;
+  std::unique_lock<std::mutex> lock {_mutex};
+  _taken.wait(lock, [this]{return !_isPending || !_thread.joinable();});
 }
 
-std::unique_ptr<Screen> screen {nullptr};
+RenderThread::Stats RenderThread::getStats() const
+{
+  std::lock_guard<std::mutex> lock {_mutex};
+  return _stats;
+}
 
-//------------------------------------------------------------------------------------------------
-//  SNAKE                                                                                         
-//------------------------------------------------------------------------------------------------
+void RenderThread::renderMain()
+{
+  sk::renderer->makeContextCurrent(true);
+  while(true){
+    {
+      std::unique_lock<std::mutex> lock {_mutex};
+      _published.wait(lock, [this]{return _isPending || _isDone;});
+      if(!_isPending)
+        break;
+      std::swap(_readNo, _pendingNo);
+      _isPending = false;
+    }
+    _taken.notify_one();
+    render(_frames[_readNo]);
+  }
+  sk::renderer->makeContextCurrent(false);
+}
 
-//class Snake
-//{
-//public:
-//  enum MoveDirection { NORTH, SOUTH, EAST, WEST };
-//  enum MoveAxis { HORIZONTAL = 0, VERTICAL = 1 };
-//  enum MoveMagnitude { NEGATIVE = -1, POSITIVE = 1 };
-//
-//  enum SegmentType { 
-//    BODY_EW, BODY_WE, BODY_NS, BODY_SN, CORNER_EN, CORNER_NE, CORNER_WN, CORNER_NW, CORNER_ES, 
-//    CORNER_SE, CORNER_WS, CORNER_SW, HEAD_E, HEAD_W, HEAD_N, HEAD_S, TAIL_E, TAIL_W, TAIL_N, 
-//    TAIL_S 
-//  };
-//
-//  struct Segment
-//  {
-//    Vector2i _position;         // [x:col, y:row] w.r.t block world.
-//    MoveDirection _direction;   // segment's local direction of movement (seperate to the snake).
-//    SegmentType _type;          // used to draw the snake correctly (to select sprites).
-//  };
-//
-//public:
-//  Snake(Vector2i worldDimensions, Vector2i);
-//  ~Snake() = default;
-//  void update(float dt);
-//  void setMoveDirection(MoveDirection direction);
-//
-//private:
-//  static constexpr float moveFrequency {2.f};             // unit: move (block) jumps per second.
-//  static constexpr float movePeriod {1 / moveFrequency};
-//  static constexpr int appetite {1};                      // nuggets eaten until full (until grow).
-//
-//private:
-//  void doMove();
-//  void calculateSegmentMoveDirection(Segment& segment, Vector2i oldPosition, Vector2i newPosition);
-//  void recalculateSegmentTypes();
-//
-//private:
-//  std::vector<Segment> _segments;
-//  Vector2i _worldDimensions;
-//  MoveAxis _moveAxis;
-//  MoveMagnitude _moveMagnitude;
-//  float _moveClock;
-//  int _nuggetsEaten;
-//};
-//
-//void Snake::update(float dt)
-//{
-//  _moveClock += dt;
-//  if(_moveClock > movePeriod){
-//    _moveClock = 0;
-//    doMove();
-//  }
-//}
-//
-//void Snake::doMove()
-//{
-//  // move head segment.
-//  Segment& head = _segments[0];
-//  Vector2i oldPosition = head._position;
-//  head._position._x += (_moveAxis == HORIZONTAL) ? _moveMagnitude : 0;
-//  head._position._y += (_moveAxis == VERTICAL) ? _moveMagnitude : 0;
-//  calculateSegmentMoveDirection(head, oldPosition, head._position); 
-//
-//  // wrap head around world if exceed world bounds.
-//  if(head._position._x < 0)
-//    head._position._x = _worldDimensions._x - 1;
-//  else if(head._position._x >= _worldDimensions._x - 1)
-//    head._position._x = 0;
-//  else if(head._position._y < 0)
-//    head._position._y = _worldDimensions._y - 1;
-//  else if(head._position._y >= _worldDimensions._y - 1)
-//    head._position._y = 0;
-//
-//  // shift body segments.
-//  for(int i = 1; i < _segments.size(); ++i){
-//    Segment& segment = _segments[i];
-//    Vector2i temp = segment._position;
-//    segment._position = oldPosition;
-//    calculateSegmentMoveDirection(segment, temp, segment._position); 
-//    oldPosition = temp;
-//  }
-//
-//  // add a segment if snake is full of nuggets.
-//  if(_neggetsEaten == appetite){
-//    Segment newTail {};
-//    newTail._position = oldPosition;
-//
-//    // uses the old tail's old position (oldPosition) and the old tail's new position.
-//    calculateSegmentMoveDirection(segment, oldPosition, _segments.back()._position); 
-//
-//    _segments.push_back(newTail);
-//  }
-//
-//  // ensures the drawing reflects the change in snake position.
-//  recalculateSegmentTypes();
-//}
-//
-//void Snake::calculateSegmentMoveDirection(Segment& segment, Vector2i oldPosition, Vector2i newPosition)
-//{
-//  int deltaRow = newPosition._y - oldPosition._y;
-//  int deltaCol = newPosition._x - oldPosition._x;
-//
-//  // Segments (except the head) shift into the position of their neighbour which is closest to 
-//  // the head, this pattern of movement will always satisfy the below conditions. Thus if these
-//  // conditions are not met then the snake is dancing something funky!
-//  assert(-1 >= deltaRow && deltaRow <= 1);
-//  assert(-1 >= deltaCol && deltaCol <= 1);
-//  assert(deltaRow == 0 || deltaCol == 0);
-//  assert(deltaRow != deltaCol);
-//
-//  MoveDirection direction;
-//  if(deltaRow != 0)
-//    direction = (deltaRow == 1) ? NORTH : SOUTH;
-//  else
-//    direction = (deltaRow == 1) ? NORTH : SOUTH;
-//
-//  segment._moveDirection = direction;
-//}
-//
-//void Snake::recalculateSegmentTypes()
-//{
-//  // calculate head type.
-//  switch(_segments.front()._moveDirection)
-//  {
-//  case NORTH:
-//    _segments.front()._type = HEAD_N;
-//    break;
-//  case SOUTH:
-//    _segments.front()._type = HEAD_S;
-//    break;
-//  case EAST:
-//    _segments.front()._type = HEAD_E;
-//    break;
-//  case WEST:
-//    _segments.front()._type = HEAD_W;
-//    break;
-//  };
-//
-//  // calculate tail type.
-//  switch(_segments.back()._moveDirection)
-//  {
-//  case NORTH:
-//    _segments.back()._type = TAIL_N;
-//    break;
-//  case SOUTH:
-//    _segments.back()._type = TAIL_S;
-//    break;
-//  case EAST:
-//    _segments.back()._type = TAIL_E;
-//    break;
-//  case WEST:
-//    _segments.back()._type = TAIL_W;
-//    break;
-//  };
-//
-//  // calculate types of all body segments.
-//  Segment dummy;
-//  for(int i = 1; i < _segments.size() - 1; ++i){
-//    Segment& thisSegment = _segments[i];
-//
-//    Vector2i thisPosition = thisSegment._position;
-//    Vector2i headNeighbourPosition = _segments[i - 1]._position;
-//    Vector2i tailNeighbourPosition = _segments[i + 1]._position;
-//
-//    MoveDirection directionToHead, directionToTail;
-//    calculateSegmentMoveDirection(dummy, thisPosition, headNeighbourPosition);
-//    directionToHead = dummy._moveDirection;
-//    calculateSegmentMoveDirection(dummy, thisPosition, tailNeighbourPosition);
-//    directionToTail = dummy._moveDirection;
-//
-//    switch(directionToHead)
-//    {
-//    case NORTH:
-//      switch(directionToTail)
-//      {
-//        case NORTH:
-//          assert(0);
-//          break;
-//        case SOUTH:
-//          thisSegment._type = BODY_SN;
-//          break;
-//        case EAST:
-//          thisSegment._type = CORNER_EN;
-//          break;
-//        case WEST:
-//          thisSegment._type = CORNER_WN;
-//          break;
-//      }
-//      break;
-//    case SOUTH:
-//      switch(directionToTail)
-//      {
-//        case NORTH:
-//          thisSegment._type = BODY_NS;
-//          break;
-//        case SOUTH:
-//          assert(0);
-//          break;
-//        case EAST:
-//          thisSegment._type = CORNER_ES;
-//          break;
-//        case WEST:
-//          thisSegment._type = CORNER_WS;
-//          break;
-//      }
-//      break;
-//    case EAST:
-//      switch(directionToTail)
-//      {
-//        case NORTH:
-//          thisSegment._type = CORNER_NE;
-//          break;
-//        case SOUTH:
-//          thisSegment._type = CORNER_SE;
-//          break;
-//        case EAST:
-//          assert(0);
-//          break;
-//        case WEST:
-//          thisSegment._type = BODY_WE;
-//          break;
-//      }
-//      break;
-//    case WEST:
-//      switch(directionToTail)
-//      {
-//        case NORTH:
-//          thisSegment._type = CORNER_NW;
-//          break;
-//        case SOUTH:
-//          thisSegment._type = CORNER_SW;
-//          break;
-//        case EAST:
-//          thisSegment._type = BODY_EW;
-//          break;
-//        case WEST:
-//          assert(0);
-//          break;
-//      }
-//      break;
-//    }
-//  }
-//}
-//
-//void Snake::setMoveDirection(MoveDirection direction)
-//{
-//  switch(direction)
-//  {
-//  case SOUTH:
-//    _moveAxis = VERTICAL;
-//    _moveMagnitude = NEGATIVE;
-//    break;
-//  case north:
-//    _moveAxis = VERTICAL;
-//    _moveMagnitude = POSITIVE;
-//    break;
-//  case east:
-//    _moveAxis = HORIZONTAL;
-//    _moveMagnitude = POSITIVE;
-//    break;
-//  case west:
-//    _moveAxis = HORIZONTAL;
-//    _moveMagnitude = NEGATIVE;
-//    break;
-//  }
-//}
+void RenderThread::render(const Screen::Frame& frame)
+{
+  auto now0 = Clock_t::now();
+  if(frame._windowSize._x != _windowSize._x || frame._windowSize._y != _windowSize._y){
+    sk::renderer->setViewport(iRect{0, 0, frame._windowSize._x, frame._windowSize._y});
+    _windowSize = frame._windowSize;
+  }
+  if(frame._renderMode != sk::renderer->getRenderMode())
+    sk::renderer->setRenderMode(frame._renderMode);
+  sk::renderer->clearWindow(_clearColor);
+  _presenter.present(frame);
+  auto now1 = Clock_t::now();
+  sk::renderer->show();
+  auto now2 = Clock_t::now();
+
+  std::lock_guard<std::mutex> lock {_mutex};
+  ++_stats._numFrames;
+  _stats._totalRenderTime += now1 - now0;
+  _stats._maxRenderTime = std::max(_stats._maxRenderTime, Duration_t{now1 - now0});
+  _stats._totalSwapTime += now2 - now1;
+  _stats._maxSwapTime = std::max(_stats._maxSwapTime, Duration_t{now2 - now1});
+  _stats._presenterStats = _presenter.getStats();
+}
 
-class Game
+// Paces the app's loop to a fixed frame period, waiting at the end of each frame until the next
+// frame's deadline. Deadlines are absolute (each one period after the last) so errors do not
+// accumulate; if a frame overruns its deadline by more than a period the schedule restarts from
+// the current time rather than trying to catch up.
+//
+// The wait strategy is selectable since the most accurate differs between machines:
+//
+//   PACE_SLEEP    - a relative std::this_thread::sleep_for; simple but on linux oversleeps by
+//                   anything from 50us to 1ms.
+//
+//   PACE_HYBRID   - sleeps until a margin before the deadline then spins (yielding) until the
+//                   deadline; accurate at the cost of a little cpu.
+//
+//   PACE_ABSOLUTE - clock_nanosleep to the deadline with TIMER_ABSTIME; avoids the drift of
+//                   relative sleeps and any wake-up spent computing them.
+//
+//   PACE_VSYNC    - does not wait; the swap (Renderer::show) on the render thread blocks until 
+//                   the display refreshes and the loop waits on the render thread to take each 
+//                   frame. The period is taken from the display's refresh rate.
+//
+// Each strategy records the error of each frame's actual end time against its deadline (for 
+// vsync the error of the actual against the refresh period) so strategies can be compared.
+//
+// references:
+// [0] https://en.wikipedia.org/wiki/Algorithms_for_calculating_variance#Welford's_online_algorithm
+class FramePacer
 {
 public:
-  enum ColorID { 
-    COLOR_WORLD_BACKGROUND,
-    COLOR_SNAKE_BODY_LIGHT,
-    COLOR_SNAKE_BODY_SHADED,
-    COLOR_SNAKE_BODY_SHADOW,
-    COLOR_SNAKE_EYES,
-    COLOR_SNAKE_TONGUE,
-    COLOR_SNAKE_SPOTS
+  using Clock_t = std::chrono::steady_clock;
+  using TimePoint_t = std::chrono::time_point<Clock_t>;
+  using Duration_t = std::chrono::nanoseconds;
+  enum Strategy { PACE_SLEEP, PACE_HYBRID, PACE_ABSOLUTE, PACE_VSYNC };
+  struct Stats
+  {
+    int64_t _numFrames;
+    int64_t _numMissed;                  // frames which overran their deadline.
+    double _meanError_us;                // positive errors are late.
+    double _stdDevError_us;
+    double _maxError_us;
   };
 public:
-  Game();
-  ~Game() = default;
-  void draw();
+  FramePacer(Strategy strategy, Duration_t period);
+  ~FramePacer() = default;
+  void wait();
+  Strategy getStrategy() const {return _strategy;}
+  Duration_t getPeriod() const {return _period;}
+  Stats getStats() const;
+  static const char* getStrategyName(Strategy strategy);
 private:
-  static constexpr Vector2i worldDimensions {50, 50}; // [x:width(num cols), y:height(num rows)]
+  void recordError(Duration_t error);
+  static void sleepUntil(TimePoint_t deadline);
 private:
-  void generateSprites();
+  static constexpr Duration_t spinMargin {static_cast<int64_t>(1.5e6)};
 private:
-  std::vector<Color4> _palette;
-
-  // Sprite assets.
-  std::vector<Sprite> _snakeSprites;
+  Strategy _strategy;
+  Duration_t _period;
+  TimePoint_t _frameStart;               // of the current frame; the last frame's deadline.
+  int64_t _numFrames;
+  int64_t _numMissed;
+  double _meanError_ns;                  // running mean and sum of squared deviations [0].
+  double _m2Error_ns;
+  double _maxError_ns;
 };
 
-Game::Game()
+FramePacer::FramePacer(Strategy strategy, Duration_t period) :
+  _strategy{strategy},
+  _period{period},
+  _frameStart{Clock_t::now()},
+  _numFrames{0},
+  _numMissed{0},
+  _meanError_ns{0.0},
+  _m2Error_ns{0.0},
+  _maxError_ns{0.0}
+{}
+
+void FramePacer::wait()
 {
-  _palette.push_back(colors::jet);
-  _palette.push_back(Color4(255, 217,  0));
-  _palette.push_back(Color4(172, 146,  0));
-  _palette.push_back(Color4( 42,  42, 42));
-  _palette.push_back(Color4(214,   0,  0));
-  _palette.push_back(Color4(214,   0,  0));
-  _palette.push_back(Color4(  4,  69,  0));
+  if(_strategy == PACE_VSYNC){
+    TimePoint_t now = Clock_t::now();
+    recordError((now - _frameStart) - _period);
+    _frameStart = now;
+    return;
+  }
+
+  TimePoint_t deadline = _frameStart + _period;
+  TimePoint_t now = Clock_t::now();
+  if(now >= deadline){
+    ++_numMissed;
+    recordError(now - deadline);
+    _frameStart = (now - deadline > _period) ? now : deadline;
+    return;
+  }
+
+  switch(_strategy)
+  {
+  case PACE_SLEEP:
+    std::this_thread::sleep_for(deadline - now);
+    break;
+  case PACE_HYBRID:
+    if(deadline - now > spinMargin)
+      std::this_thread::sleep_for((deadline - now) - spinMargin);
+    while(Clock_t::now() < deadline)
+      std::this_thread::yield();
+    break;
+  case PACE_ABSOLUTE:
+    sleepUntil(deadline);
+    break;
+  case PACE_VSYNC:
+    break;
+  }
 
-  generateSprites();
+  recordError(Clock_t::now() - deadline);
+  _frameStart = deadline;
 }
 
-void Game::generateSprites()
+// note: the deadline is converted to CLOCK_MONOTONIC via the current time of each clock rather
+// than assuming steady_clock uses CLOCK_MONOTONIC.
+void FramePacer::sleepUntil(TimePoint_t deadline)
 {
-  const std::vector<Color4>& p = _palette;
-
-  _snakeSprites.push_back({{p[3], p[3], p[3], p[3], p[2], p[2], p[2], p[2], p[1], p[1], p[1], 
-                            p[1], p[6], p[1], p[1], p[1]}, 4, 4});
+  struct timespec monotonicNow;
+  clock_gettime(CLOCK_MONOTONIC, &monotonicNow);
+  int64_t remaining_ns = std::chrono::duration_cast<Duration_t>(deadline - Clock_t::now()).count();
+  int64_t target_ns = (monotonicNow.tv_sec * 1000000000LL) + monotonicNow.tv_nsec + remaining_ns;
+
+  struct timespec target;
+  target.tv_sec = target_ns / 1000000000LL;
+  target.tv_nsec = target_ns % 1000000000LL;
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR);
+}
 
-  Image image;
-  image.loadBmp("indexed4Colors.bmp");
-  _snakeSprites.push_back(Sprite{image.getPixels(), image.getWidth(), image.getHeight()});
+void FramePacer::recordError(Duration_t error)
+{
+  double error_ns = static_cast<double>(error.count());
+  ++_numFrames;
+  double delta = error_ns - _meanError_ns;
+  _meanError_ns += delta / _numFrames;
+  _m2Error_ns += delta * (error_ns - _meanError_ns);
+  if(_numFrames == 1 || error_ns > _maxError_ns)
+    _maxError_ns = error_ns;
 }
 
-void Game::draw()
+FramePacer::Stats FramePacer::getStats() const
 {
-  sk::screen->clear(colors::gainsboro);
-  sk::screen->drawSprite(30, 30, _snakeSprites[0]);
-  sk::screen->drawSprite(50, 50, _snakeSprites[1]);
+  Stats stats;
+  stats._numFrames = _numFrames;
+  stats._numMissed = _numMissed;
+  stats._meanError_us = _meanError_ns / 1000.0;
+  stats._stdDevError_us = (_numFrames > 1) ? std::sqrt(_m2Error_ns / (_numFrames - 1)) / 1000.0 : 0.0;
+  stats._maxError_us = _maxError_ns / 1000.0;
+  return stats;
 }
 
-//------------------------------------------------------------------------------------------------
-//  APP                                                                                           
-//------------------------------------------------------------------------------------------------
+const char* FramePacer::getStrategyName(Strategy strategy)
+{
+  switch(strategy)
+  {
+  case PACE_SLEEP: return "sleep";
+  case PACE_HYBRID: return "hybrid";
+  case PACE_ABSOLUTE: return "absolute";
+  case PACE_VSYNC: return "vsync";
+  }
+  return "";
+}
 
 class App
 {
@@ -1616,22 +6089,85 @@ private:
     TimePoint_t _now1;
     Duration_t _dt;
   };
-  class Metronome
+public:
+  // note: with the software backend the app is run headless; each loop does exactly one sim 
+  // tick and renders one frame without sleeping, so runs are as fast and as repeatable as 
+  // possible. 
+  struct Config
+  {
+    Renderer::Backend _backend;
+    Screen::ColorMode _screenColorMode;
+    FramePacer::Strategy _pacing;
+    int64_t _maxFrames;                  // the app quits after this many frames; 0 to never.
+    const char* _captureFilename;        // if not null the last frame is captured to this file.
+    bool _isAutopilotOn;                 // the autopilot plays from the start; toggle with p.
+  };
+  static constexpr Config defaultConfig {Renderer::BACKEND_OPENGL, Screen::COLOR_DIRECT, 
+                                         FramePacer::PACE_HYBRID, 0, nullptr, false};
+private:
+  // Schedules fixed-step ticks for a number of rate groups, each ticking at its own period but
+  // all driven by the same clock (the now passed to update). On each update the number of ticks
+  // a group has due is computed directly from the elapsed time; the tick times are fixed (the 
+  // start time plus a whole number of periods) so tick timing does not depend on when updates
+  // happen to occur.
+  //
+  // Each group runs at most maxTicksPerUpdate ticks per update; the remainder (the backlog) is
+  // handled by the group's backlog policy:
+  //
+  //   BACKLOG_CATCH_UP - the backlog is kept and run over later updates, but only up to 
+  //                      maxBacklog ticks; any more are dropped so that after a stall (e.g. a 
+  //                      window drag) the group catches up in bounded time.
+  //
+  //   BACKLOG_DROP     - the backlog is dropped; the group only ever runs the latest ticks.
+  //
+  // Ticks run more than a period after their tick time are counted as late.
+  //
+  // Each update also gives each group's interpolation, the fraction [0, 1) of a period elapsed 
+  // since the group's last tick time; state advanced by ticks can be drawn this fraction of the
+  // way from its previous to its current tick value.
+  class Scheduler
   {
   public:
-    Metronome(Duration_t appNow, Duration_t tickPeriod_ns);
-    ~Metronome() = default;
-    int64_t doTicks(Duration_t appNow);
-    Duration_t getTickPeriod_ns() const {return _tickPeriod_ns;}
-    float getTickPeriod_s() const {return _tickPeriod_s;}
+    enum BacklogPolicy { BACKLOG_CATCH_UP, BACKLOG_DROP };
+    struct GroupConfig
+    {
+      Duration_t _period;
+      int _maxTicksPerUpdate;
+      int _maxBacklog;
+      BacklogPolicy _backlogPolicy;
+    };
+    struct GroupStats
+    {
+      int64_t _numTicks;
+      int64_t _numLateTicks;
+      int64_t _numDroppedTicks;
+    };
+  public:
+    Scheduler() = default;
+    ~Scheduler() = default;
+    int addGroup(const GroupConfig& config);
+    void start(Duration_t now);
+    void update(Duration_t now);
+    int getNumTicks(int groupNo) const {return _groups[groupNo]._numTicksToRun;}
+    Duration_t getPeriod(int groupNo) const {return _groups[groupNo]._config._period;}
+    float getPeriod_s(int groupNo) const;
+    float getInterpolation(int groupNo) const {return _groups[groupNo]._interpolation;}
+    const GroupStats& getStats(int groupNo) const {return _groups[groupNo]._stats;}
+  private:
+    struct Group
+    {
+      GroupConfig _config;
+      Duration_t _nextTickTime;          // of the next tick to become due.
+      int64_t _backlog;
+      int _numTicksToRun;                // this update.
+      float _interpolation;              // this update.
+      GroupStats _stats;
+    };
   private:
-    Duration_t _lastTickNow;
-    Duration_t _tickPeriod_ns;
-    float _tickPeriod_s;
-    int64_t _totalTicks;
+    std::vector<Group> _groups;
   };
 public:
-  App();
+  App(const Config& config = defaultConfig);
   ~App();
   App(const App&) = delete;
   App(const App&&) = delete;
@@ -1642,20 +6178,41 @@ public:
   void run();
 private:
   void loop();
-  void onTick(float dt);
+  void onTick(int tickGroup, float dt);
+  void render(float interpolation);
+  void reportHeadlessRun();
+  void initializePacer();
 private:
   static constexpr const char* name = "snake";
   static constexpr int appVersionMajor = 0;
   static constexpr int appVersionMinor = 1;
+  static constexpr const char* spritePackFilename = "assets.skpak";
   static constexpr int windowWidth_px = 700;
   static constexpr int windowHeight_px = 200;
-  static constexpr int maxTicksPerFrame = 5;
+  static constexpr Renderer::RenderMode renderMode = Renderer::RENDER_TEXTURE;
+
+  // the scheduler's rate groups; the simulation must not skip time so catches up, whereas the
+  // ai and ui need only act on the latest state.
+  enum TickGroup { TICK_SIM, TICK_AI, TICK_UI, TICK_GROUP_COUNT };
+  static constexpr std::array<Scheduler::GroupConfig, TICK_GROUP_COUNT> tickGroupConfigs {{
+    {Duration_t{static_cast<int64_t>(0.016e9)}, 5, 60, Scheduler::BACKLOG_CATCH_UP},
+    {Duration_t{static_cast<int64_t>(0.050e9)}, 1, 0, Scheduler::BACKLOG_DROP},
+    {Duration_t{static_cast<int64_t>(0.033e9)}, 1, 0, Scheduler::BACKLOG_DROP}
+  }};
+  static constexpr std::array<const char*, TICK_GROUP_COUNT> tickGroupNames {"sim", "ai", "ui"};
   static constexpr Duration_t minFramePeriod {static_cast<int64_t>(0.01e9)};
 private:
+  Config _config;
   RealClock _clock;
-  Metronome _metronome;
-  int64_t _ticksAccumulated;
+  Scheduler _scheduler;
+  FramePacer _pacer;
+  RenderThread _renderThread;
+  Renderer::RenderMode _renderMode;
+  Duration_t _headlessNow;               // the clock driving the scheduler in headless runs.
   bool _isDone;
+  int64_t _numFrames;
+  Duration_t _totalFrameTime;
+  Duration_t _maxFrameTime;
 
   Game _game;
 };
@@ -1668,32 +6225,86 @@ App::Duration_t App::RealClock::update()
   return _dt;
 }
 
-App::Metronome::Metronome(App::Duration_t appNow, App::Duration_t tickPeriod_ns) :
-  _lastTickNow{appNow},
-  _tickPeriod_ns{tickPeriod_ns},
-  _tickPeriod_s{static_cast<float>(_tickPeriod_ns.count()) / 1.0e9f},
-  _totalTicks{0}
+// Returns the group's number; groups are numbered in the order added.
+int App::Scheduler::addGroup(const GroupConfig& config)
+{
+  assert(config._period.count() > 0);
+  assert(config._maxTicksPerUpdate > 0);
+  _groups.push_back(Group{config, Duration_t{0}, 0, 0, 0.f, GroupStats{0, 0, 0}});
+  return static_cast<int>(_groups.size()) - 1;
+}
+
+// Sets the time of every group's first tick to one period after now and clears any backlog.
+void App::Scheduler::start(Duration_t now)
 {
+  for(auto& group : _groups){
+    group._nextTickTime = now + group._config._period;
+    group._backlog = 0;
+    group._numTicksToRun = 0;
+    group._interpolation = 0.f;
+  }
 }
 
-int64_t App::Metronome::doTicks(Duration_t appNow)
+// Calculates the number of ticks each group is to run for the time now; see getNumTicks.
+void App::Scheduler::update(Duration_t now)
 {
-  int64_t ticks;
-  while(_lastTickNow + _tickPeriod_ns < appNow){
-    _lastTickNow += _tickPeriod_ns;
-    ++ticks;
+  for(auto& group : _groups){
+    const GroupConfig& config = group._config;
+
+    int64_t numDue {0};
+    if(now >= group._nextTickTime){
+      numDue = ((now - group._nextTickTime) / config._period) + 1;
+      group._nextTickTime += numDue * config._period;
+    }
+
+    // all backlog ticks, and all but the latest of the ticks just due, are at least a period 
+    // past their tick times.
+    int64_t numPending = group._backlog + numDue;
+    int64_t numLate = group._backlog + std::max(numDue - 1, int64_t{0});
+    int64_t numToRun = std::min(numPending, static_cast<int64_t>(config._maxTicksPerUpdate));
+
+    int64_t backlog = numPending - numToRun;
+    int64_t maxBacklog = (config._backlogPolicy == BACKLOG_CATCH_UP) ? config._maxBacklog : 0;
+    if(backlog > maxBacklog){
+      group._stats._numDroppedTicks += backlog - maxBacklog;
+      backlog = maxBacklog;
+    }
+
+    group._backlog = backlog;
+    group._numTicksToRun = static_cast<int>(numToRun);
+
+    // the fraction of a period since the last tick time; with a backlog the ticks run are all
+    // behind so the latest state is used as is.
+    Duration_t sinceLastTick = now - (group._nextTickTime - config._period);
+    group._interpolation = (backlog > 0) ? 1.f : static_cast<float>(sinceLastTick.count()) / 
+                                                 static_cast<float>(config._period.count());
+    group._stats._numTicks += numToRun;
+    group._stats._numLateTicks += std::min(numLate, numToRun);
   }
-  _totalTicks += ticks;
-  return ticks;
 }
 
-App::App() : 
+float App::Scheduler::getPeriod_s(int groupNo) const
+{
+  return static_cast<float>(_groups[groupNo]._config._period.count()) / 1.0e9f;
+}
+
+App::App(const Config& config) : 
+  _config{config},
   _clock{}, 
-  _metronome{_clock.getNow(), Duration_t{static_cast<int64_t>(0.016e9)}},
-  _ticksAccumulated{0},
+  _scheduler{},
+  _pacer{config._pacing, minFramePeriod},
+  _renderThread{colors::jet},
+  _renderMode{renderMode},
+  _headlessNow{0},
   _isDone{false},
+  _numFrames{0},
+  _totalFrameTime{0},
+  _maxFrameTime{0},
   _game{}
 {
+  for(const auto& groupConfig : tickGroupConfigs)
+    _scheduler.addGroup(groupConfig);
+  _game.setAutopilot(config._isAutopilotOn);
 }
 
 App::~App()
@@ -1703,11 +6314,27 @@ App::~App()
 void App::initialize()
 {
   sk::log = std::make_unique<Log>();
+  sk::assetLoader = std::make_unique<AssetLoader>();
+
+  sk::spritePack = std::make_unique<SpritePack>();
+  if(sk::spritePack->open(spritePackFilename) != 0){
+    sk::log->log(Log::INFO, logstr::info_no_sprite_pack, spritePackFilename);
+    sk::spritePack.reset(nullptr);
+  }
+
+  // assets decode on the loader's workers while the window and opengl context are created.
+  _game.requestAssets();
+
   sk::input = std::make_unique<Input>();
-  sk::screen = std::make_unique<Screen>(Vector2i{windowWidth_px, windowHeight_px});
+  sk::screen = std::make_unique<Screen>(Vector2i{windowWidth_px, windowHeight_px}, 
+                                       _config._screenColorMode);
+
+  // the dummy video driver lets the event loop run with no display.
+  if(_config._backend == Renderer::BACKEND_SOFTWARE)
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
 
   if(SDL_Init(SDL_INIT_VIDEO) < 0){
-    sk::log->log(Log::FATAL, logstr::fail_sdl_init, std::string{SDL_GetError()});
+    sk::log->log(Log::FATAL, logstr::fail_sdl_init, SDL_GetError());
     exit(EXIT_FAILURE);
   }
 
@@ -1718,16 +6345,116 @@ void App::initialize()
      << "."
      << appVersionMinor;
 
-  Renderer::Config rconfig {std::string{ss.str()}, windowWidth_px, windowHeight_px};
+  Renderer::Config rconfig {std::string{ss.str()}, windowWidth_px, windowHeight_px, renderMode, 
+                           _config._backend};
   renderer = std::make_unique<Renderer>(rconfig);
 
   Vector2i windowSize = sk::renderer->getWindowSize();
   if(windowSize._x != windowWidth_px || windowSize._y != windowHeight_px)
     sk::screen->rescalePixels(windowSize);
+
+  initializePacer();
+
+  _game.generateSprites();
+
+  _renderMode = sk::renderer->getRenderMode();
+
+  // headless runs render on the main thread so every frame is rendered and timed.
+  if(_config._backend != Renderer::BACKEND_SOFTWARE)
+    _renderThread.start();
+}
+
+// Vsync pacing is at the display's refresh period and falls back to hybrid pacing if vsync is
+// unavailable; other strategies disable vsync so the swap does not also wait.
+void App::initializePacer()
+{
+  FramePacer::Strategy strategy = _pacer.getStrategy();
+  Duration_t period = minFramePeriod;
+  if(strategy == FramePacer::PACE_VSYNC){
+    if(sk::renderer->setSwapInterval(1) == 0){
+      int refreshRate = sk::renderer->getRefreshRate();
+      if(refreshRate > 0)
+        period = Duration_t{1000000000LL / refreshRate};
+    }
+    else{
+      sk::log->log(Log::WARN, logstr::warn_no_vsync);
+      strategy = FramePacer::PACE_HYBRID;
+    }
+  }
+  if(strategy != FramePacer::PACE_VSYNC)
+    sk::renderer->setSwapInterval(0);
+
+  _pacer = FramePacer{strategy, period};
+  sk::log->log(Log::INFO, logstr::info_frame_pacing, FramePacer::getStrategyName(strategy));
 }
 
 void App::shutdown()
 {
+  _renderThread.stop();
+
+  char addendum[160];
+  int64_t meanFrameTime_ns = (_numFrames > 0) ? _totalFrameTime.count() / _numFrames : 0;
+  snprintf(addendum, sizeof(addendum), "{frames:%lld,mean_us:%lld,max_us:%lld}",
+           static_cast<long long>(_numFrames), static_cast<long long>(meanFrameTime_ns / 1000),
+           static_cast<long long>(_maxFrameTime.count() / 1000));
+  sk::log->log(Log::INFO, logstr::info_main_thread_stats, addendum);
+
+  RenderThread::Stats renderStats = _renderThread.getStats();
+  int64_t numRendered = std::max(renderStats._numFrames, int64_t{1});
+  snprintf(addendum, sizeof(addendum), 
+           "{frames:%lld,superseded:%lld,render_mean_us:%lld,render_max_us:%lld,swap_mean_us:%lld,swap_max_us:%lld}",
+           static_cast<long long>(renderStats._numFrames), 
+           static_cast<long long>(renderStats._numSuperseded),
+           static_cast<long long>(renderStats._totalRenderTime.count() / numRendered / 1000),
+           static_cast<long long>(renderStats._maxRenderTime.count() / 1000),
+           static_cast<long long>(renderStats._totalSwapTime.count() / numRendered / 1000),
+           static_cast<long long>(renderStats._maxSwapTime.count() / 1000));
+  sk::log->log(Log::INFO, logstr::info_render_thread_stats, addendum);
+
+  const ScreenPresenter::Stats& presenterStats = renderStats._presenterStats;
+  int64_t numPresented = std::max(presenterStats._numFrames, int64_t{1});
+  snprintf(addendum, sizeof(addendum), 
+           "{frames:%lld,rects_mean:%.1f,dirty_mean_pct:%.1f,dirty_max_pct:%.1f}",
+           static_cast<long long>(presenterStats._numFrames),
+           static_cast<double>(presenterStats._numDirtyRects) / numPresented,
+           100.0 * presenterStats._numDirtyPixels / (numPresented * Screen::pixelCount),
+           100.0 * presenterStats._maxDirtyPixels / Screen::pixelCount);
+  sk::log->log(Log::INFO, logstr::info_dirty_rect_stats, addendum);
+
+  FramePacer::Stats stats = _pacer.getStats();
+  snprintf(addendum, sizeof(addendum), 
+           "{strategy:%s,frames:%lld,missed:%lld,mean_us:%.1f,stddev_us:%.1f,max_us:%.1f}",
+           FramePacer::getStrategyName(_pacer.getStrategy()), 
+           static_cast<long long>(stats._numFrames), static_cast<long long>(stats._numMissed),
+           stats._meanError_us, stats._stdDevError_us, stats._maxError_us);
+  sk::log->log(Log::INFO, logstr::info_frame_pacing_stats, addendum);
+
+  for(int group = 0; group < TICK_GROUP_COUNT; ++group){
+    const Scheduler::GroupStats& tickStats = _scheduler.getStats(group);
+    snprintf(addendum, sizeof(addendum), "{group:%s,ticks:%lld,late:%lld,dropped:%lld}",
+             tickGroupNames[group], static_cast<long long>(tickStats._numTicks), 
+             static_cast<long long>(tickStats._numLateTicks), 
+             static_cast<long long>(tickStats._numDroppedTicks));
+    sk::log->log(Log::INFO, logstr::info_tick_stats, addendum);
+  }
+
+  const Autopilot::Stats& autopilotStats = _game.getAutopilotStats();
+  double decisionTime_s = std::chrono::duration<double>(autopilotStats._totalDecisionTime).count();
+  snprintf(addendum, sizeof(addendum), 
+           "{decisions:%lld,plans:%lld,unsafe_paths:%lld,partial_paths:%lld,fallbacks:%lld,decisions_per_s:%.0f,plan_mean_us:%lld,plan_max_us:%lld}",
+           static_cast<long long>(autopilotStats._numDecisions),
+           static_cast<long long>(autopilotStats._numPlans),
+           static_cast<long long>(autopilotStats._numUnsafePaths),
+           static_cast<long long>(autopilotStats._numPartialPaths),
+           static_cast<long long>(autopilotStats._numFallbacks),
+           (decisionTime_s > 0.0) ? autopilotStats._numDecisions / decisionTime_s : 0.0,
+           static_cast<long long>(autopilotStats._totalPlanTime.count() / 
+                                  std::max(autopilotStats._numPlans, int64_t{1}) / 1000),
+           static_cast<long long>(autopilotStats._maxPlanTime.count() / 1000));
+  sk::log->log(Log::INFO, logstr::info_autopilot_stats, addendum);
+
+  sk::assetLoader.reset(nullptr);
+  sk::spritePack.reset(nullptr);
   sk::log.reset(nullptr);
   sk::input.reset(nullptr);
   sk::renderer.reset(nullptr);
@@ -1735,15 +6462,41 @@ void App::shutdown()
 
 void App::run()
 {
+  _clock.start();
+  _scheduler.start(Duration_t{0});
   while(!_isDone)
     loop();
+  _renderThread.stop();
+  if(_config._backend == Renderer::BACKEND_SOFTWARE)
+    reportHeadlessRun();
+}
+
+void App::reportHeadlessRun()
+{
+  if(_config._captureFilename != nullptr)
+    sk::renderer->captureFramebuffer(_config._captureFilename);
+
+  RenderThread::Stats renderStats = _renderThread.getStats();
+  int64_t numRendered = std::max(renderStats._numFrames, int64_t{1});
+  int64_t meanFrameTime_ns = (_numFrames > 0) ? _totalFrameTime.count() / _numFrames : 0;
+  std::cout << "frames: " << _numFrames
+            << " mean frame time (us): " << meanFrameTime_ns / 1000
+            << " max frame time (us): " << _maxFrameTime.count() / 1000
+            << " rendered: " << renderStats._numFrames
+            << " mean render time (us): " << renderStats._totalRenderTime.count() / numRendered / 1000
+            << " max render time (us): " << renderStats._maxRenderTime.count() / 1000
+            << " last frame hash: " << std::hex << sk::renderer->hashFramebuffer() << std::dec
+            << std::endl;
 }
 
 void App::loop()
 {
-  auto now0 = Clock_t::now();
-  auto realDt = _clock.update();
-  auto realNow = _clock.getNow();
+  _clock.update();
+
+  // a resize (e.g. dragging the window border) can generate many size changes per frame; only
+  // the last need be applied.
+  bool isResized {false};
+  Vector2i windowSize {0, 0};
 
   SDL_Event event;
   while(SDL_PollEvent(&event) != 0){
@@ -1753,11 +6506,9 @@ void App::loop()
         return;
       case SDL_WINDOWEVENT:
         if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
-          int w, h;
-          w = event.window.data1;
-          h = event.window.data2;
-          sk::renderer->setViewport(iRect{0, 0, w, h});
-          sk::screen->rescalePixels(Vector2i{w, h});
+          windowSize._x = event.window.data1;
+          windowSize._y = event.window.data2;
+          isResized = true;
         }
         break;
       case SDL_KEYDOWN:
@@ -1766,44 +6517,145 @@ void App::loop()
     }
   }
 
-  _ticksAccumulated += _metronome.doTicks(realNow);
-  int64_t ticksDoneThisFrame {0};
-  while(_ticksAccumulated > 0 && ticksDoneThisFrame < maxTicksPerFrame){
-    ++ticksDoneThisFrame;
-    --_ticksAccumulated;
-    onTick(_metronome.getTickPeriod_s());
+  // note: the viewport is set by the render thread when it renders the resized screen.
+  if(isResized)
+    sk::screen->rescalePixels(windowSize);
+
+  // toggles the render mode to compare the render paths.
+  if(sk::input->isKeyPressed(Input::KEY_r)){
+    Renderer::RenderMode mode = (_renderMode == Renderer::RENDER_TEXTURE) ? Renderer::RENDER_POINTS : 
+                                                                            Renderer::RENDER_TEXTURE;
+    if(sk::renderer->isRenderModeSupported(mode))
+      _renderMode = mode;
+  }
+
+  if(sk::input->isKeyPressed(Input::KEY_p))
+    _game.setAutopilot(!_game.isAutopilotOn());
+
+  // headless runs advance time by exactly one sim tick per loop.
+  if(_config._backend == Renderer::BACKEND_SOFTWARE){
+    _headlessNow += tickGroupConfigs[TICK_SIM]._period;
+    _scheduler.update(_headlessNow);
   }
+  else
+    _scheduler.update(_clock.getNow());
+
+  for(int group = 0; group < TICK_GROUP_COUNT; ++group)
+    for(int tick = 0; tick < _scheduler.getNumTicks(group); ++tick)
+      onTick(group, _scheduler.getPeriod_s(group));
+
+  render(_scheduler.getInterpolation(TICK_SIM));
 
   sk::input->onUpdate();
 
-  auto now1 = Clock_t::now();
-  auto framePeriod = now1 - now0;
-  if(framePeriod < minFramePeriod)
-    std::this_thread::sleep_for(minFramePeriod - framePeriod);
+  if(_config._backend == Renderer::BACKEND_SOFTWARE)
+    return;
+
+  // with vsync the render thread is paced by the swap and the main thread by the render thread.
+  if(_pacer.getStrategy() == FramePacer::PACE_VSYNC)
+    _renderThread.waitForTake();
+  _pacer.wait();
 }
 
-void App::onTick(float dt)
+// Ticks only advance state; nothing is drawn.
+void App::onTick(int tickGroup, float dt)
 {
-  sk::renderer->clearWindow(colors::jet);
-  _game.draw();
-  sk::screen->render();
-  sk::renderer->show();
+  switch(tickGroup)
+  {
+  case TICK_SIM:
+    _game.onTick(dt);
+    break;
+  case TICK_AI:
+    _game.onAiTick();
+    break;
+  case TICK_UI:
+    break;                               // the game has no ui yet.
+  }
+}
+
+// Draws one frame per loop regardless of the number of ticks run and hands it to the render 
+// thread.
+void App::render(float interpolation)
+{
+  auto now0 = Clock_t::now();
+  _game.draw(interpolation);
+  Screen::Frame& frame = _renderThread.getWriteFrame();
+  sk::screen->capture(frame);
+  frame._renderMode = _renderMode;
+  _renderThread.publish();
+  auto frameTime = Clock_t::now() - now0;
+
+  ++_numFrames;
+  _totalFrameTime += frameTime;
+  _maxFrameTime = std::max(_maxFrameTime, Duration_t{frameTime});
+  if(_config._maxFrames != 0 && _numFrames >= _config._maxFrames)
+    _isDone = true;
 }
 
 std::unique_ptr<App> app {nullptr};
 
+#endif // SK_SIM_ONLY
+
 }; // namespace sk
 
 //------------------------------------------------------------------------------------------------
 //  MAIN                                                                                          
 //------------------------------------------------------------------------------------------------
 
-int main()
+// note: tools which build on the game code (e.g. benchmarks) include this file and define
+// SK_NO_MAIN (or SK_SIM_ONLY) to supply their own main.
+#if !defined(SK_NO_MAIN) && !defined(SK_SIM_ONLY)
+
+// usage: snake [-headless] [-indexed] [-pacing <strategy>] [-frames <n>] [-capture <ppm file>]
+//              [-autopilot]
+//
+//   -headless   render with the software backend; no display or gpu is needed.
+//   -indexed    use an indexed (8-bit palette) screen.
+//   -pacing     frame pacing strategy; one of sleep, hybrid (default), absolute or vsync.
+//   -frames     quit after n frames.
+//   -capture    capture the last frame to a ppm file (headless only).
+//   -autopilot  start with the autopilot playing (p toggles it).
+bool parsePacing(const char* name, sk::FramePacer::Strategy& strategy)
+{
+  for(auto s : {sk::FramePacer::PACE_SLEEP, sk::FramePacer::PACE_HYBRID, 
+                sk::FramePacer::PACE_ABSOLUTE, sk::FramePacer::PACE_VSYNC}){
+    if(strcmp(name, sk::FramePacer::getStrategyName(s)) == 0){
+      strategy = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char* argv[])
 {
-  sk::app = std::make_unique<sk::App>();
+  sk::App::Config config {sk::App::defaultConfig};
+  for(int i = 1; i < argc; ++i){
+    if(strcmp(argv[i], "-headless") == 0)
+      config._backend = sk::Renderer::BACKEND_SOFTWARE;
+    else if(strcmp(argv[i], "-indexed") == 0)
+      config._screenColorMode = sk::Screen::COLOR_INDEXED;
+    else if(strcmp(argv[i], "-pacing") == 0 && i + 1 < argc && parsePacing(argv[i + 1], config._pacing))
+      ++i;
+    else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+      config._maxFrames = std::max(0L, strtol(argv[++i], nullptr, 10));
+    else if(strcmp(argv[i], "-capture") == 0 && i + 1 < argc)
+      config._captureFilename = argv[++i];
+    else if(strcmp(argv[i], "-autopilot") == 0)
+      config._isAutopilotOn = true;
+    else{
+      fprintf(stderr, "usage: %s [-headless] [-indexed] [-pacing <strategy>] [-frames <n>] "
+                      "[-capture <ppm file>] [-autopilot]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  sk::app = std::make_unique<sk::App>(config);
   sk::app->initialize();
   sk::app->run();
   sk::app->shutdown();
   sk::app.reset(nullptr);
 }
 
+#endif
+